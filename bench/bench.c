@@ -0,0 +1,227 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** headless benchmark ***/
+
+/* Replays key scripts through editorProcessKeypress() and
+   editorRefreshScreen() against a virtual terminal of a given size and
+   reports, per operation, the latency of each key (key handling plus the
+   frame it causes) and the bytes each frame sends. Frames go to /dev/null;
+   the report goes to the original stdout.
+
+   A script has one operation per line:
+
+       name count keys
+
+   'keys' is replayed 'count' times and may use the escapes \e \r \n \t
+   \\ and \xHH. Lines starting with '#' are comments. Every repetition
+   must leave the editor at the top level, not inside a prompt. A key that
+   opens a prompt is timed together with the prompt keys that follow it. */
+
+struct benchOp {
+    char name[32];
+    double *us;
+    int n, cap;
+    long long bytes;
+    int maxBytes;
+};
+
+static struct benchOp *ops;
+static int nOps, capOps;
+
+static struct benchOp *benchOpFind(const char *name){
+    int i;
+    for(i = 0; i < nOps; ++i){
+        if(strcmp(ops[i].name, name) == 0) return &ops[i];
+    }
+    if(nOps == capOps){
+        capOps = capOps ? capOps * 2 : 16;
+        ops = realloc(ops, capOps * sizeof(*ops));
+        if(ops == NULL) die("realloc");
+    }
+    struct benchOp *op = &ops[nOps++];
+    memset(op, 0, sizeof(*op));
+    snprintf(op -> name, sizeof(op -> name), "%s", name);
+    return op;
+}
+
+static void benchRecord(struct benchOp *op, double us, int bytes){
+    if(op -> n == op -> cap){
+        op -> cap = op -> cap ? op -> cap * 2 : 256;
+        op -> us = realloc(op -> us, op -> cap * sizeof(double));
+        if(op -> us == NULL) die("realloc");
+    }
+    op -> us[op -> n++] = us;
+    op -> bytes += bytes;
+    if(bytes > op -> maxBytes) op -> maxBytes = bytes;
+}
+
+static double benchNowUs(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+/* Decodes the escapes of a script's key field in place and returns its
+   length, or -1 on a malformed \x escape. */
+static int benchUnescape(char *s){
+    char *start = s;
+    char *out = s;
+    while(*s){
+        if(*s != '\\' || s[1] == '\0'){
+            *out++ = *s++;
+            continue;
+        }
+        s++;
+        switch(*s){
+            case 'e': *out++ = '\x1b'; s++; break;
+            case 'r': *out++ = '\r'; s++; break;
+            case 'n': *out++ = '\n'; s++; break;
+            case 't': *out++ = '\t'; s++; break;
+            case 'x':
+                {
+                    unsigned v;
+                    int used;
+                    if(sscanf(s + 1, "%2x%n", &v, &used) != 1) return -1;
+                    *out++ = v;
+                    s += 1 + used;
+                }
+                break;
+            default: *out++ = *s++; break;
+        }
+    }
+    return out - start;
+}
+
+/* Runs every repetition of one operation, timing each key separately. */
+static void benchReplay(struct benchOp *op, const char *keys, int len, int count){
+    while(count--){
+        editorInputFeed(keys, len);
+        while(editorInputPending()){
+            double t0 = benchNowUs();
+            editorProcessKeypress();
+            editorRefreshScreen();
+            benchRecord(op, benchNowUs() - t0, editorFrameBytes());
+        }
+    }
+}
+
+static void benchScript(const char *path){
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL) die(path);
+    char *line = NULL;
+    size_t lineCap = 0;
+    ssize_t lineLen;
+    int lineNo = 0;
+    while((lineLen = getline(&line, &lineCap, fp)) != -1){
+        lineNo++;
+        while(lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r'))
+            line[--lineLen] = '\0';
+        if(lineLen == 0 || line[0] == '#') continue;
+
+        char name[32];
+        int count, at;
+        int len = -1;
+        if(sscanf(line, "%31s %d %n", name, &count, &at) == 2 && line[at] != '\0')
+            len = benchUnescape(line + at);
+        if(len <= 0){
+            fprintf(stderr, "%s:%d: expected 'name count keys'\n", path, lineNo);
+            exit(1);
+        }
+        benchReplay(benchOpFind(name), line + at, len, count);
+    }
+    free(line);
+    fclose(fp);
+}
+
+static int benchCompare(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void benchReport(FILE *out){
+    fprintf(out, "%-14s %7s %10s %10s %10s %12s %10s\n",
+            "operation", "keys", "p50 us", "p99 us", "max us", "bytes/frame", "max bytes");
+    int i;
+    for(i = 0; i < nOps; ++i){
+        struct benchOp *op = &ops[i];
+        if(op -> n == 0) continue;
+        qsort(op -> us, op -> n, sizeof(double), benchCompare);
+        fprintf(out, "%-14s %7d %10.1f %10.1f %10.1f %12.0f %10d\n",
+                op -> name, op -> n,
+                op -> us[op -> n / 2], op -> us[(op -> n * 99) / 100], op -> us[op -> n - 1],
+                (double)op -> bytes / op -> n, op -> maxBytes);
+    }
+}
+
+/* Writes a reproducible document of 'lines' lines of words to a temp file,
+   named .c so that it is syntax highlighted. */
+static char *benchDocument(int lines){
+    static char path[] = "/tmp/B-bench.XXXXXX.c";
+    int fd = mkstemps(path, 2);
+    if(fd == -1) die("mkstemps");
+    FILE *fp = fdopen(fd, "w");
+    if(fp == NULL) die("fdopen");
+    static const char *words[] = {
+        "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+        "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+        "\tet", "dolore", "magna", "aliqua", "{", "}", "return", "0;"
+    };
+    unsigned seed = 1;
+    int i;
+    for(i = 0; i < lines; ++i){
+        int n = (seed >> 16) % 14;
+        while(n--){
+            seed = seed * 1103515245 + 12345;
+            fputs(words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))], fp);
+            fputc(' ', fp);
+        }
+        seed = seed * 1103515245 + 12345;
+        fputc('\n', fp);
+    }
+    if(fclose(fp) == EOF) die("fclose");
+    return path;
+}
+
+int main(int argc, char *argv[]){
+    int rows = 24, cols = 80, lines = 100000;
+    int opt;
+    while((opt = getopt(argc, argv, "r:c:l:")) != -1){
+        switch(opt){
+            case 'r': rows = atoi(optarg); break;
+            case 'c': cols = atoi(optarg); break;
+            case 'l': lines = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-r rows] [-c cols] [-l lines] script...\n", argv[0]);
+                return 1;
+        }
+    }
+    if(optind == argc || rows < 3 || cols < 1 || lines < 0){
+        fprintf(stderr, "usage: %s [-r rows] [-c cols] [-l lines] script...\n", argv[0]);
+        return 1;
+    }
+
+    /* Frames go to /dev/null, so the report needs its own stdout. */
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    int null = open("/dev/null", O_RDWR);
+    if(out == NULL || null == -1) die("/dev/null");
+    dup2(null, STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+
+    E.screenRows = rows - 2;
+    E.screenCols = cols;
+    char *doc = benchDocument(lines);
+    editorOpen(doc);
+
+    int i;
+    for(i = optind; i < argc; ++i) benchScript(argv[i]);
+
+    fprintf(out, "%d x %d terminal, %d-line document\n", cols, rows, lines);
+    benchReport(out);
+    fclose(out);
+    editorJournalClose(1);
+    unlink(doc);
+    return 0;
+}
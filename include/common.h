@@ -24,6 +24,15 @@
 #include<time.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <signal.h>
 
 
 
@@ -37,6 +46,94 @@
 #define CTRL_KEY(k) ((k) & 0x1f)
 #define TAB_STOP 8  
 #define B_QUIT_TIMES 3
+/* Seconds a status message stays on screen. */
+#define STATUS_MSG_SECONDS 5
+/* How long to wait for the rest of an escape sequence before taking the
+   Escape key on its own. */
+#define ESC_SEQ_TIMEOUT_MS 100
+/* Bytes taken from the terminal per read(). */
+#define INPUT_BUF_BYTES 4096
+/* Keys that are already buffered are applied without redrawing in
+   between, but the screen is redrawn at least this often. */
+#define FRAME_DEADLINE_MS 16
+/* Events kept by the trace ring buffer; must be a power of two. */
+#define TRACE_RING_EVENTS (1 << 16)
+
+/* Trace scopes around hot paths: TRACE_BEGIN(name) starts a timed scope
+   and TRACE_END(name) records it as a trace event; TRACE_FRAME also feeds
+   the perf overlay. Building with -DB_NO_TRACE (make TRACE=0) turns them
+   into no-ops. */
+#ifndef B_NO_TRACE
+#define TRACE_BEGIN(name) uint64_t traceStart_##name = editorTraceNow()
+#define TRACE_END(name) editorTraceEvent(#name, traceStart_##name)
+#define TRACE_FRAME(name, bytes) (TRACE_END(name), editorTraceFrame(traceStart_##name, bytes))
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_FRAME(name, bytes) ((void)0)
+#endif
+
+/* Line store geometry: rows live in fixed-size blocks that hang off a
+   counted B-tree, so line insert/delete/lookup stay O(log n). */
+#define ROW_BLOCK_ROWS 64
+#define ROW_NODE_FANOUT 32
+/* Files at least this large are memory-mapped instead of read line by line. */
+#define B_MMAP_THRESHOLD (16 * 1024 * 1024)
+/* Bytes per newline-scan task when indexing a mapped file. */
+#define LINE_CHUNK_BYTES (16 * 1024 * 1024)
+/* Upper bound on worker threads in the pool (the caller also runs tasks). */
+#define POOL_MAX_THREADS 16
+/* Row allocator: buffers of ROW_SLAB_MIN to ROW_SLAB_MAX bytes come in
+   power-of-two size classes carved from ROW_ARENA_BYTES arenas; loaded
+   text is packed into arenas of the same size. */
+#define ROW_SLAB_MIN 16
+#define ROW_SLAB_MAX 4096
+#define ROW_ARENA_BYTES (1024 * 1024)
+/* Rows up to this long without tabs are stored inside the erow itself;
+   it matches the size of the fields a heap row uses instead. */
+#define ROW_INLINE_BYTES 32
+/* Rows at least this long, or with non-ASCII text, get a column index
+   over chunks of ROW_INDEX_CHUNK_MIN to ROW_INDEX_CHUNK_MAX bytes and only
+   their visible columns are rendered; long ASCII rows go back to a plain
+   render buffer below half of ROW_LONG_BYTES. */
+#define ROW_LONG_BYTES (64 * 1024)
+#define ROW_INDEX_CHUNK_MIN 64
+#define ROW_INDEX_CHUNK_MAX 4096
+/* Most bytes a screen line of n columns is rendered into: up to 4 per
+   column for UTF-8, and a little more for combining marks. */
+#define SCREEN_LINE_BYTES(cols) (4 * (cols) + 16)
+/* Regex limits: NFA nodes per pattern and cached DFA states per matcher. */
+#define REGEX_MAX_NODES 4096
+#define REGEX_MAX_STATES 256
+/* Most matches the search keeps positions for before it falls back to
+   scanning rows on demand. */
+#define MATCH_SET_MAX (1 << 22)
+/* Rows per background search task. */
+#define SEARCH_TASK_ROWS 4096
+/* Rows per replace-all task. */
+#define REPLACE_TASK_ROWS 4096
+/* Saving streams rows out with writev in batches of at most this many
+   bytes or iovecs. */
+#define SAVE_CHUNK_BYTES (1024 * 1024)
+#define SAVE_IOV_MAX 1024
+/* Edit journal: records are buffered in memory and written out when the
+   buffer fills or the oldest unwritten record is this many ms old. */
+#define JOURNAL_BUF_BYTES (64 * 1024)
+#define JOURNAL_FLUSH_MS 1000
+/* Undo text is kept in arena chunks of this size. */
+#define UNDO_CHUNK_BYTES (64 * 1024)
+
+/* Highlight classes of screen columns: syntax classes (syntax.c), with
+   search matches drawn over them. */
+enum editorHighlight {
+    HL_NORMAL = 0,
+    HL_COMMENT,
+    HL_KEYWORD1,
+    HL_KEYWORD2,
+    HL_STRING,
+    HL_NUMBER,
+    HL_MATCH
+};
 
 
 
@@ -58,7 +155,9 @@ enum editorKey {
   HOME_KEY,
   END_KEY,
   PAGE_UP,
-  PAGE_DOWN
+  PAGE_DOWN,
+  WAKE_KEY,
+  PASTE_KEY
 };
 
 
@@ -4,13 +4,170 @@
 #include <termios.h>
 #include<common.h>
 
+/**
+ * @brief One line of text.
+ * @details Short tab-free rows (ROW_INLINE) keep their text in text.inl,
+ * in the space the heap fields would take, so they cost no allocation.
+ * Other rows use text.ext: chars is a gap buffer of cap bytes, the first
+ * gap bytes being the text before the gap and the last (size - gap) bytes
+ * the text after it. ROW_MAPPED rows point into E.map and are copied on
+ * their first modification. render is built lazily: staleFrom is the
+ * first column whose rendering is out of date, or -1 when it is current.
+ * A row without tabs whose text is contiguous has no render buffer of its
+ * own (render is NULL) and is drawn straight from its text; see
+ * editorRowRender(). ROW_INDEXED rows (long or non-ASCII) keep no render
+ * buffer at all; view holds their column index instead (see row_index.c).
+ * flags describe where the text is and viewFlags how it is drawn: search
+ * workers read the text while the input thread redraws, so drawing only
+ * ever writes viewFlags, view, rCap and the render fields.
+ * hlState is the syntax lexer's state at the end of the row (syntax.c).
+ */
+#define ROW_MAPPED 1
+#define ROW_INLINE 2
+#define ROW_INDEXED 4
+
+struct rowIndex;
+
 typedef struct erow {
+    union {
+        struct {
+            char *chars;
+            union {
+                char *render;
+                struct rowIndex *index;
+            } view;
+            int gap;
+            int cap;
+            int rCap;
+        } ext;
+        char inl[ROW_INLINE_BYTES];
+    } text;
     int size;
     int rSize;
-    char *chars;
-    char *render;
+    int staleFrom;
+    unsigned char flags;
+    unsigned char viewFlags;
+    unsigned char hlState;
 } erow;
 
+/**
+ * @brief Leaf of the line store: a run of consecutive rows.
+ */
+typedef struct rowBlock {
+    int n;
+    erow rows[ROW_BLOCK_ROWS];
+} rowBlock;
+
+/**
+ * @brief Interior node of the line store's counted B-tree.
+ * @details counts[i] is the number of rows below kids[i]; kids are
+ * rowBlocks when the node sits directly above the leaves.
+ */
+typedef struct rowNode {
+    int n;
+    int counts[ROW_NODE_FANOUT];
+    void *kids[ROW_NODE_FANOUT];
+} rowNode;
+
+/**
+ * @brief A compiled literal search query (see search.c).
+ * @details first/last are the pattern's end bytes; in case-insensitive
+ * mode the fold masks are 0x20 for letters so that (byte | fold) == first
+ * accepts either case.
+ */
+typedef struct searchPattern {
+    char *needle;
+    char *window;
+    int len;
+    int icase;
+    int kernel;
+    unsigned char first;
+    unsigned char last;
+    unsigned char firstFold;
+    unsigned char lastFold;
+} searchPattern;
+
+/**
+ * @brief A compiled regular expression (see regex.c).
+ * @details nodes is a Thompson NFA of the pattern, or of the pattern
+ * reversed, starting at start; classes holds one 256-bit byte set per
+ * character class.
+ */
+typedef struct reNode {
+    int op;
+    int out;
+    int out1;
+    int cls;
+} reNode;
+
+typedef struct regex {
+    reNode *nodes;
+    int nNodes;
+    int capNodes;
+    unsigned char (*classes)[32];
+    int nClasses;
+    int capClasses;
+    int start;
+} regex;
+
+/**
+ * @brief Lazily built DFA over a regex, one per searching thread.
+ * @details States are created on first use: trans holds 256 next-state
+ * entries per state (-1 until built), accept flags the accepting ones.
+ * Once REGEX_MAX_STATES exist the whole cache is flushed.
+ */
+typedef struct dfaState dfaState;
+
+typedef struct regexDfa {
+    const regex *re;
+    int anchored;
+    dfaState *states;
+    char *accept;
+    int *trans;
+    int nStates;
+    int *table;
+    int *setPool;
+    int poolUsed;
+    int poolCap;
+    int *mark;
+    int gen;
+    int *set;
+    int *stack;
+    int begin[2];
+    int flushes;
+} regexDfa;
+
+/**
+ * @brief A compiled search query (see matches.c).
+ * @details Literal queries use pattern. Regex queries are compiled twice:
+ * rev finds where matches start, fwd (run anchored) where they end.
+ */
+typedef struct searchQuery {
+    char *text;
+    int icase;
+    int regex;
+    int ok;
+    searchPattern pattern;
+    regex rev;
+    regex fwd;
+    regexDfa revDfa;
+    regexDfa fwdDfa;
+} searchQuery;
+
+/**
+ * @brief One match of the current query: len chars at row, col.
+ */
+typedef struct matchPos {
+    int row;
+    int col;
+    int len;
+} matchPos;
+
+struct rowStore {
+    void *root;
+    int height;
+};
+
 struct editorConfig {
     int cx, cy;
     int rx;
@@ -21,9 +178,11 @@ struct editorConfig {
     int numRows;
     char statusMsg[80];
     time_t statusMsgTime;
-    erow *row;
+    struct rowStore rows;
     int dirty;
     char *fileName;
+    char *map;
+    size_t mapLen;
     struct termios orig_termios;
 };
 
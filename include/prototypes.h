@@ -8,28 +8,111 @@
 void die(const char *s);
 void disableRawMode();
 void enableRawMode();
+void editorWake();
 int editorReadKey();
+int editorInputPending();
+void editorInputFeed(const char *s, size_t len);
+char *editorPasteText(size_t *len);
 int getWindowSize(int *rows, int *cols);
 int getCursorPosition(int *rows, int *cols);
 
 // row.c
 void editorInsertRow(int at, char *s, size_t len);
+void editorInsertMappedRow(int at, char *s, size_t len);
+void editorRowAttach(erow *row, char *s);
+void editorRowInitMapped(erow *row, char *s, size_t len);
+void editorRowInitCopy(erow *row, const char *s, size_t len);
 void editorUpdateRow(erow *row);
+char *editorRowRender(erow *row, int col, int width, char *buf, int *len);
+void editorRowInvalidate(erow *row, int at);
 int editorRowCxToRx(erow *row, int cx);
+int editorRowDecode(erow *row, int at, int *cp);
+int editorRowCharStart(erow *row, int at);
+int editorRowNextCx(erow *row, int at);
+int editorRowPrevCx(erow *row, int at);
+int editorRowSnapCx(erow *row, int at);
 void editorRowInsertChar(erow *row, int at, int c);
 void editorRowDelChar(erow *row, int at);
 void editorFreeRow(erow *row);
 void editorDelRow(int at);
 void editorRowAppendString(erow *row, char *s, size_t len);
 int editorRowRxToCx(erow *row, int rx);
+void editorRowSpans(erow *row, char **a, int *aLen, char **b, int *bLen);
+int editorRowCharAt(erow *row, int at);
+void editorRowInsertString(erow *row, int at, const char *s, size_t len);
+void editorRowDelRange(erow *row, int at, int len);
+int editorRowTail(erow *row, int at, char **tail);
+void editorRowTruncate(erow *row, int at);
+void editorRowSetText(erow *row, const char *s, size_t len);
+
+// row_mem.c
+char *editorRowMemAlloc(int size, int *cap);
+void editorRowMemFree(char *p, int cap);
+char *editorRowMemText(const char *s, size_t len);
+void editorRowMemRelease();
+
+// row_index.c
+void editorRowIndexTouch(erow *row, int from, int to);
+void editorRowIndexFree(erow *row);
+int editorRowIndexWidth(erow *row);
+int editorRowIndexCxToRx(erow *row, int cx);
+int editorRowIndexRxToCx(erow *row, int rx);
+char *editorRowIndexRender(erow *row, int col, int width, char *buf, int *len);
+
+// utf8.c
+int editorUtf8Width(int cp);
+int editorUtf8Decode(const char *s, int len, int *cp);
+int editorUtf8Ascii(const char *s, int len);
+
+// row_store.c
+erow *editorRowAt(int at);
+erow *editorRowRun(int at, int *len);
+erow *editorRowStoreInsert(int at);
+void editorRowStoreDelete(int at);
+void editorRowStoreLoad(int n, void (*fill)(erow *rows, int count, void *arg), void *arg);
+void editorRowStoreClear();
+
+// line_index.c
+void editorIndexLines(char *map, size_t len);
+
+// pool.c
+int editorPoolThreads();
+void editorPoolRun(int tasks, void (*fn)(int task, void *arg), void *arg);
+void editorPoolStart(int tasks, void (*fn)(int task, void *arg), void *arg);
+void editorPoolWait();
 
 // file_io.c
 void editorOpen(char *fileName);
-char *editorRowsToString(int *buflen);
 void editorSave();
+// journal.c
+void editorJournalOpen(const char *fileName);
+void editorJournalClose(int discard);
+void editorJournalFlush();
+int editorJournalDueMs();
+void editorJournalInsertChar(int row, int col, int c);
+void editorJournalDelChar(int row, int col);
+void editorJournalSplit(int row, int col);
+void editorJournalJoin(int row);
+void editorJournalDelRow(int row);
+void editorJournalInsertText(int row, int col, const char *s, size_t len);
+void editorJournalDelRange(int row, int col, int endRow, int endCol);
+void editorJournalReplace(int row, int col, int oldLen, const char *s, size_t len);
+// undo.c
+void editorUndoInsertChar(int row, int col, int c);
+void editorUndoDelChar(int row, int col, int c);
+void editorUndoSplit(int row, int col);
+void editorUndoJoin(int row, int col);
+void editorUndoNewRow(int row, int chain);
+void editorUndoInsertText(int row, int col, const char *s, size_t len);
+void editorUndoReplace(const char *query, const char *with);
+void editorUndoReplaceRow(int at, const int *cols, int n);
+void editorUndo();
+void editorRedo();
 // output.c
 void editorRefreshScreen();
+void editorInvalidateFrame();
 void editorScroll();
+int editorFrameBytes();
 void editorSetStatusMessage(const char *fmt, ...);
 // input.c
 void editorMoveCursor(int key);
@@ -39,12 +122,62 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int));
 // main.c
 void initEditor();
 
+// trace.c
+uint64_t editorTraceNow();
+void editorTraceEvent(const char *name, uint64_t start);
+void editorTraceFrame(uint64_t start, int bytes);
+int editorTraceDump(const char *path);
+void editorTraceDumpAtExit(const char *path);
+void editorTraceToggleOverlay();
+int editorTraceOverlay(char *buf, int size);
+
 // editor.c
 void editorInsertChar(int c);
 void editorDelChar();
 void editorInsertNewline();
+void editorInsertText(const char *s, size_t len);
+void editorDelRange(int row, int col, int endRow, int endCol);
+
+// syntax.c
+void editorSyntaxSelect(const char *fileName);
+const char *editorSyntaxName();
+void editorSyntaxTouch(int row);
+void editorSyntaxRowInserted(int at);
+void editorSyntaxRowDeleted(int at);
+void editorSyntaxUpdate(int upTo);
+int editorSyntaxRow(erow *row, int fileRow, int col, int width, unsigned char *hl);
 
 // find.c
 void editorFind();
 
+// replace.c
+void editorReplaceAll();
+void editorReplaceReplay(const char *text, size_t len, int reverse);
+
+// search.c
+void editorPatternInit(searchPattern *p, const char *query, int icase);
+void editorPatternFree(searchPattern *p);
+int editorPatternFind(const searchPattern *p, const char *s, int from, int len);
+int editorSearchRow(searchPattern *p, erow *row, int from);
+int editorPatternMatchAt(searchPattern *p, erow *row, int at);
+int editorSearchForward(searchPattern *p, int at, int from, int end, int *col);
+
+// matches.c
+void editorMatchesReset();
+int editorMatchesSearch(const char *text, int icase, int regex, const char **error);
+void editorMatchesPoll();
+int editorMatchesNext(int row, int col, int dir, matchPos *out);
+int editorMatchesInRow(int at, matchPos **out);
+int editorMatchesStatus(char *buf, int size);
+
+// regex.c
+int editorRegexCompile(regex *re, const char *pattern, int icase, int reverse, const char **error);
+void editorRegexFree(regex *re);
+void editorDfaInit(regexDfa *d, const regex *re, int anchored);
+void editorDfaFree(regexDfa *d);
+int editorRegexSearchRow(regexDfa *d, erow *row, int from);
+int editorRegexSearchForward(regexDfa *d, int at, int from, int end, int *col);
+int editorRegexMatchEnd(regexDfa *d, erow *row, int from);
+int editorRegexStarts(regexDfa *d, erow *row, char *hits);
+
 #endif
\ No newline at end of file
@@ -4,40 +4,119 @@
 
 void editorInsertChar(int c){
     if(E.cy == E.numRows){
+        editorUndoNewRow(E.numRows, 1);
         editorInsertRow(E.numRows, "", 0);
     }
-    editorRowInsertChar(&E.row[E.cy], E.cx, c);
+    editorJournalInsertChar(E.cy, E.cx, c);
+    editorUndoInsertChar(E.cy, E.cx, c);
+    editorSyntaxTouch(E.cy);
+    editorRowInsertChar(editorRowAt(E.cy), E.cx, c);
     E.cx++;
 }
 
 void editorDelChar(){
     if(E.cy == E.numRows) return;
     if(E.cx == 0 && E.cy == 0) return;
-    erow *row = &E.row[E.cy];
+    erow *row = editorRowAt(E.cy);
     if(E.cx > 0){
+        editorJournalDelChar(E.cy, E.cx - 1);
+        editorUndoDelChar(E.cy, E.cx - 1, editorRowCharAt(row, E.cx - 1));
+        editorSyntaxTouch(E.cy);
         editorRowDelChar(row, E.cx - 1);
         E.cx--;
     }
     else{
-        E.cx = E.row[E.cy - 1].size;
-        editorRowAppendString(&E.row[E.cy - 1], row -> chars, row -> size);
+        editorJournalJoin(E.cy);
+        char *text;
+        int len = editorRowTail(row, 0, &text);
+        erow *prev = editorRowAt(E.cy - 1);
+        editorUndoJoin(E.cy, prev -> size);
+        E.cx = prev -> size;
+        editorSyntaxTouch(E.cy - 1);
+        editorRowAppendString(prev, text, len);
         editorDelRow(E.cy);
         E.cy--;
     }
 }
 
 void editorInsertNewline(){
+    editorJournalSplit(E.cy, E.cx);
+    if(E.cy == E.numRows) editorUndoNewRow(E.cy, 0);
+    else editorUndoSplit(E.cy, E.cx);
     if(E.cx == 0){
         editorInsertRow(E.cy, "", 0);
     }
     else{
-        erow *row = &E.row[E.cy];
-        editorInsertRow(E.cy + 1, &row -> chars[E.cx], row -> size - E.cx);
-        row = &E.row[E.cy];
-        row -> size = E.cx;
-        row -> chars[row -> size] = '\0';
-        editorUpdateRow(row);
+        char *tail;
+        int tailLen = editorRowTail(editorRowAt(E.cy), E.cx, &tail);
+        editorInsertRow(E.cy + 1, tail, tailLen);
+        editorSyntaxTouch(E.cy);
+        editorRowTruncate(editorRowAt(E.cy), E.cx);
     }
     E.cy++;
     E.cx = 0;
-}
\ No newline at end of file
+}
+/* Inserts a block of text at the cursor in one operation and leaves the
+   cursor after it. Lines are separated by '\n'; the text after the cursor
+   moves to the end of the last inserted line. */
+void editorInsertText(const char *s, size_t len){
+    if(len == 0) return;
+    if(E.cy == E.numRows){
+        editorUndoNewRow(E.numRows, 1);
+        editorInsertRow(E.numRows, "", 0);
+    }
+    editorJournalInsertText(E.cy, E.cx, s, len);
+    editorUndoInsertText(E.cy, E.cx, s, len);
+    editorSyntaxTouch(E.cy);
+
+    erow *row = editorRowAt(E.cy);
+    const char *end = s + len;
+    const char *nl = memchr(s, '\n', len);
+    if(nl == NULL){
+        editorRowInsertString(row, E.cx, s, len);
+        E.cx += len;
+        return;
+    }
+
+    char *tail;
+    int tailLen = editorRowTail(row, E.cx, &tail);
+    char *saved = malloc(tailLen ? tailLen : 1);
+    if(saved == NULL) die("malloc");
+    memcpy(saved, tail, tailLen);
+    editorRowTruncate(row, E.cx);
+    editorRowInsertString(row, E.cx, s, nl - s);
+
+    int at = E.cy + 1;
+    const char *line = nl + 1;
+    while((nl = memchr(line, '\n', end - line)) != NULL){
+        editorInsertRow(at++, (char *)line, nl - line);
+        line = nl + 1;
+    }
+    editorInsertRow(at, (char *)line, end - line);
+    editorRowAppendString(editorRowAt(at), saved, tailLen);
+    free(saved);
+    E.cy = at;
+    E.cx = end - line;
+}
+
+/* Deletes the text from (row, col) up to (endRow, endCol) and leaves the
+   cursor at the start of the range. Used to take back a block insert, so
+   it is journaled but not recorded for undo. */
+void editorDelRange(int row, int col, int endRow, int endCol){
+    editorJournalDelRange(row, col, endRow, endCol);
+    editorSyntaxTouch(row);
+    erow *first = editorRowAt(row);
+    if(endRow == row){
+        editorRowDelRange(first, col, endCol - col);
+    }
+    else{
+        char *tail;
+        int tailLen = editorRowTail(editorRowAt(endRow), endCol, &tail);
+        editorRowTruncate(first, col);
+        editorRowAppendString(first, tail, tailLen);
+        int k;
+        for(k = row + 1; k <= endRow; ++k) editorDelRow(row + 1);
+    }
+    E.cy = row;
+    E.cx = col;
+}
@@ -2,44 +2,236 @@
 #include "../include/data.h"
 #include "../include/prototypes.h"
 
+/* After a save the file holds exactly the buffer, so every row can point
+   back into a fresh mapping of it and give up its heap copy. If the file
+   cannot be mapped the rows stay as they are, still pointing into the old
+   mapping, which stays valid after the rename. */
+static void editorRemap(int fd, size_t len){
+    char *map = NULL;
+    if(len > 0){
+        map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map == MAP_FAILED) return;
+    }
+    munmap(E.map, E.mapLen);
+    E.map = NULL;
+    E.mapLen = 0;
+    if(len == 0) return;
+
+    E.map = map;
+    E.mapLen = len;
+
+    size_t off = 0;
+    int j = 0;
+    while(j < E.numRows){
+        int runLen;
+        erow *run = editorRowRun(j, &runLen);
+        int k;
+        for(k = 0; k < runLen; ++k){
+            editorRowAttach(&run[k], map + off);
+            off += run[k].size + 1;
+        }
+        j += runLen;
+    }
+}
+
+/* Reads everything left in fd into one heap buffer, sized up front for a
+   regular file. */
+static char *editorReadAll(int fd, size_t *len){
+    struct stat st;
+    size_t cap = 64 * 1024;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t)st.st_size >= cap) cap = st.st_size + 1;
+    size_t used = 0;
+    char *buf = malloc(cap);
+    if(buf == NULL) die("malloc");
+    for(;;){
+        if(used == cap){
+            cap *= 2;
+            buf = realloc(buf, cap);
+            if(buf == NULL) die("realloc");
+        }
+        ssize_t n = read(fd, buf + used, cap - used);
+        if(n == -1){
+            if(errno == EINTR) continue;
+            die("read");
+        }
+        if(n == 0) break;
+        used += n;
+    }
+    *len = used;
+    return buf;
+}
+
+/* Smaller files are read whole and copied into rows in one bulk load,
+   which packs every block of the line store full (appending line by line
+   would leave them half empty). */
+struct loadCursor {
+    const char *p, *end;
+};
+
+static void loadRows(erow *rows, int count, void *arg){
+    struct loadCursor *cur = arg;
+    int k;
+    for(k = 0; k < count; ++k){
+        const char *nl = memchr(cur -> p, '\n', cur -> end - cur -> p);
+        size_t len = (nl ? nl : cur -> end) - cur -> p;
+        /* One '\r' goes with a CRLF line end, as in editorIndexLines(). */
+        if(len > 0 && cur -> p[len - 1] == '\r') len--;
+        editorRowInitCopy(&rows[k], cur -> p, len);
+        cur -> p = nl ? nl + 1 : cur -> end;
+    }
+}
+
 void editorOpen(char *fileName){
     free(E.fileName);
     E.fileName = strdup(fileName);
-    FILE *fp = fopen(fileName, "r");
-    if (!fp) die("fopen");
-
-    char *line = NULL;
-    size_t lineCap = 0;
-    ssize_t lineLen;
-    while((lineLen = getline(&line, &lineCap, fp)) != -1){
-        if(lineLen != -1){
-            while(lineLen > 0 && (line[lineLen - 1] == '\n' || line[lineLen - 1] == '\r'))
-                lineLen--;
+
+    int fd = open(fileName, O_RDONLY);
+    if(fd == -1) die("open");
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= B_MMAP_THRESHOLD){
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(map != MAP_FAILED){
+            close(fd);
+            E.map = map;
+            E.mapLen = st.st_size;
+            editorIndexLines(map, st.st_size);
+            E.dirty = 0;
+            editorSyntaxSelect(fileName);
+            editorJournalOpen(fileName);
+            return;
         }
-        editorInsertRow(E.numRows, line, lineLen);
     }
-    free(line);
-    fclose(fp);
+
+    size_t len;
+    char *text = editorReadAll(fd, &len);
+    close(fd);
+    size_t lines = 0;
+    const char *p = text;
+    const char *end = text + len;
+    while((p = memchr(p, '\n', end - p)) != NULL){
+        lines++;
+        p++;
+    }
+    if(len > 0 && text[len - 1] != '\n') lines++;
+    if(lines > INT_MAX) die("too many lines");
+
+    struct loadCursor cur = {text, end};
+    editorRowStoreLoad(lines, loadRows, &cur);
+    E.numRows = lines;
+    free(text);
     E.dirty = 0;
+    editorSyntaxSelect(fileName);
+    editorJournalOpen(fileName);
 }
 
-char *editorRowsToString(int *bufLen){
-    int totalLen = 0;
-    int j;
-    for(j = 0; j < E.numRows; ++j){
-        totalLen += E.row[j].size + 1;
+/*** saving ***/
+
+/* Rows are streamed out of their own buffers: each row contributes its
+   span(s) plus a shared "\n" to an iovec batch that is flushed with one
+   writev once it holds SAVE_CHUNK_BYTES or SAVE_IOV_MAX entries, so saving
+   never builds a second copy of the document. */
+struct saveBatch {
+    int fd;
+    struct iovec iov[SAVE_IOV_MAX];
+    int n;
+    size_t bytes;
+    size_t total;
+};
+
+static int saveFlush(struct saveBatch *sb){
+    struct iovec *iov = sb -> iov;
+    int n = sb -> n;
+    while(n > 0){
+        ssize_t w = writev(sb -> fd, iov, n);
+        if(w == -1){
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        sb -> total += w;
+        /* Skip what was written; a short write resumes mid-iovec. */
+        while(n > 0 && (size_t)w >= iov -> iov_len){
+            w -= iov -> iov_len;
+            iov++;
+            n--;
+        }
+        if(n > 0){
+            iov -> iov_base = (char *)iov -> iov_base + w;
+            iov -> iov_len -= w;
+        }
     }
-    *bufLen = totalLen;
-
-    char *buf = malloc(totalLen);
-    char *p = buf;
-    for(j = 0; j < E.numRows; ++j){
-        memcpy(p, E.row[j].chars, E.row[j].size);
-        p += E.row[j].size;
-        *p = '\n';
-        p++;
+    sb -> n = 0;
+    sb -> bytes = 0;
+    return 0;
+}
+
+static int saveAdd(struct saveBatch *sb, char *s, size_t len){
+    if(len == 0) return 0;
+    sb -> iov[sb -> n].iov_base = s;
+    sb -> iov[sb -> n].iov_len = len;
+    sb -> n++;
+    sb -> bytes += len;
+    if(sb -> n == SAVE_IOV_MAX || sb -> bytes >= SAVE_CHUNK_BYTES) return saveFlush(sb);
+    return 0;
+}
+
+static int editorWriteRows(int fd, size_t *len){
+    static char newline = '\n';
+    struct saveBatch sb;
+    sb.fd = fd;
+    sb.n = 0;
+    sb.bytes = 0;
+    sb.total = 0;
+
+    int j = 0;
+    while(j < E.numRows){
+        int runLen;
+        erow *run = editorRowRun(j, &runLen);
+        int k;
+        for(k = 0; k < runLen; ++k){
+            char *a, *b;
+            int aLen, bLen;
+            editorRowSpans(&run[k], &a, &aLen, &b, &bLen);
+            if(saveAdd(&sb, a, aLen) == -1) return -1;
+            if(saveAdd(&sb, b, bLen) == -1) return -1;
+            if(saveAdd(&sb, &newline, 1) == -1) return -1;
+        }
+        j += runLen;
     }
-    return buf;
+    if(saveFlush(&sb) == -1) return -1;
+    *len = sb.total;
+    return 0;
+}
+
+/* Gives the replacement file the original's mode, owner and group, or the
+   mode a plain open(O_CREAT, 0644) would have produced for a new file.
+   Only root may give a file away, so a failure to change the owner with
+   EPERM is left alone: the file is then the saving user's, as any newly
+   written file would be. */
+static int editorSaveAttrs(int fd, const char *path){
+    struct stat st;
+    if(stat(path, &st) == -1){
+        mode_t mask = umask(0);
+        umask(mask);
+        return fchmod(fd, 0644 & ~mask);
+    }
+    if(fchown(fd, st.st_uid, st.st_gid) == -1 && errno != EPERM) return -1;
+    return fchmod(fd, st.st_mode & 07777);
+}
+
+/* Flushes the directory holding path, so the rename that put the new file
+   there survives a crash too. */
+static int editorSyncDir(const char *path){
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+    if(dir == NULL) die("malloc");
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    free(dir);
+    if(fd == -1) return -1;
+    int r = fsync(fd);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return r;
 }
 
 void editorSave(){
@@ -49,25 +241,59 @@ void editorSave(){
             editorSetStatusMessage("Save aborted");
             return;
         }
+        editorSyntaxSelect(E.fileName);
     }
 
-    int len;
-    char *buf = editorRowsToString(&len);
-    
-    int fd = open(E.fileName, O_RDWR | O_CREAT, 0644);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    /* Write a sibling temp file and rename it over the original, so a crash
+       mid-save leaves either the old file or the new one, never a torn one;
+       the directory is synced after the rename so the new entry is durable.
+       A symlink is resolved first so the rename replaces its target. */
+    char *path = realpath(E.fileName, NULL);
+    if(path == NULL) path = strdup(E.fileName);
+    size_t pathLen = strlen(path);
+    char *tmp = malloc(pathLen + 8);
+    if(path == NULL || tmp == NULL) die("malloc");
+    memcpy(tmp, path, pathLen);
+    memcpy(tmp + pathLen, ".XXXXXX", 8);
+
+    size_t len = 0;
+    int fd = mkstemp(tmp);
     if(fd != -1){
-        if(ftruncate(fd, len) != -1){
-            if(write(fd, buf, len) == len){
-                close(fd);
-                free(buf);
-                E.dirty = 0;
-                editorSetStatusMessage("%d bytes written to disk", len);
-                return;
-            }
+        if(editorSaveAttrs(fd, path) != -1 &&
+           editorWriteRows(fd, &len) != -1 &&
+           fsync(fd) != -1 &&
+           rename(tmp, path) != -1){
+            /* The new file is in place from here on: a failed directory
+               sync only means the rename may not survive a crash yet. */
+            int dirErr = editorSyncDir(path) == -1 ? errno : 0;
+            if(E.map) editorRemap(fd, len);
+            close(fd);
+            free(tmp);
+            free(path);
+            E.dirty = 0;
+            /* The file now holds every journaled edit: start a fresh
+               journal against the new version. */
+            editorJournalClose(1);
+            editorJournalOpen(E.fileName);
+
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+            double rate = secs > 0 ? len / secs / (1024 * 1024) : 0;
+            if(dirErr) editorSetStatusMessage("%zu bytes written, directory not synced: %s",
+                                              len, strerror(dirErr));
+            else editorSetStatusMessage("%zu bytes written to disk in %.0f ms (%.1f MB/s)",
+                                        len, secs * 1000, rate);
+            return;
         }
+        int saved = errno;
         close(fd);
+        unlink(tmp);
+        errno = saved;
     }
-    free(buf);
+    free(tmp);
+    free(path);
     editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
-
-}
\ No newline at end of file
+}
@@ -2,45 +2,71 @@
 #include "../include/data.h"
 #include "../include/prototypes.h"
 
-void editorFindCallBack(char *query, int key){
-    static int lasMatch = -1;
-    static int direction = 1;
+static int searchIcase = 0;
+static int searchRegex = 0;
+static const char *searchError = NULL;
+static char searchPrompt[96];
+
+/* The key hints only fit on the status line next to an empty mode, so
+   they give way once regex or case mode is shown. */
+static void editorFindSetPrompt(){
+    char mode[48] = "";
+    if(searchRegex && searchError) snprintf(mode, sizeof(mode), " [regex: %.24s]", searchError);
+    else if(searchRegex) snprintf(mode, sizeof(mode), " [regex]");
+    if(searchIcase) strcat(mode, " [nocase]");
+    if(mode[0]) snprintf(searchPrompt, sizeof(searchPrompt), "Search%s: %%s", mode);
+    else snprintf(searchPrompt, sizeof(searchPrompt), "Search: %%s (ESC/Arrows/Enter, ^T case, ^E regex)");
+}
+
+void editorFindCallBack(char *text, int key){
+    static int lastRow = -1;
+    static int lastCol = -1;
+    static int pending = 0;
+    int direction = 1;
 
     if(key == '\r' || key == '\x1b'){
-        lasMatch = -1;
-        direction = 1;
+        lastRow = -1;
+        lastCol = -1;
+        pending = 0;
+        editorMatchesReset();
         return;
     }
 
+    /* The background search has more results: retry a move that was
+       waiting for them. */
+    else if(key == WAKE_KEY){
+        editorMatchesPoll();
+        if(!pending) return;
+        direction = pending;
+    }
     else if(key == ARROW_DOWN || key == ARROW_RIGHT){
         direction = 1;
     }
     else if(key == ARROW_LEFT || key == ARROW_UP){
         direction = -1;
     }
+    else if(key == CTRL_KEY('t') || key == CTRL_KEY('e')){
+        if(key == CTRL_KEY('t')) searchIcase = !searchIcase;
+        else searchRegex = !searchRegex;
+        lastRow = -1;
+    }
     else{
-        lasMatch = -1;
-        direction = 1;
+        lastRow = -1;
     }
 
-    if(lasMatch == -1) direction = 1;
-    int current = lasMatch;
+    editorMatchesSearch(text, searchIcase, searchRegex, &searchError);
+    editorFindSetPrompt();
 
-    int i;
-    for(i = 0; i < E.numRows; ++i){
-        current += direction;
-        if(current == -1) current = E.numRows - 1;
-        else if(current == E.numRows) current = 0;
-
-        erow *row = &E.row[current];
-        char *match = strstr(row -> render, query);
-        if(match){
-            lasMatch = current;
-            E.cy = current;
-            E.cx = editorRowRxToCx(row, match - row -> render);
-            E.rowOff = E.numRows;
-            break;
-        }
+    matchPos m;
+    if(lastRow == -1) direction = 1;
+    int found = editorMatchesNext(lastRow, lastCol, direction, &m);
+    pending = found < 0 ? direction : 0;
+    if(found > 0){
+        lastRow = m.row;
+        lastCol = m.col;
+        E.cy = m.row;
+        E.cx = m.col;
+        E.rowOff = E.numRows;
     }
 }
 
@@ -50,9 +76,9 @@ void editorFind(){
     int prevCy = E.cy;
     int prevColOff = E.colOff;
     int prevRowOff = E.rowOff;
-    char *query = editorPrompt("Search: %s (Use ESC/Arrows/Enter)",
-                             editorFindCallBack);
-    if(query == NULL) return;
+    searchError = NULL;
+    editorFindSetPrompt();
+    char *query = editorPrompt(searchPrompt, editorFindCallBack);
 
     if(query){
         free(query);
@@ -63,4 +89,4 @@ void editorFind(){
         E.colOff = prevColOff;
         E.rowOff = prevRowOff;
     }
-}
\ No newline at end of file
+}
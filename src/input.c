@@ -3,22 +3,22 @@
 #include "../include/prototypes.h"
 
 void editorMoveCursor(int key){
-    erow *row = (E.cy >= E.numRows) ? NULL : &E.row[E.cy];
+    erow *row = (E.cy >= E.numRows) ? NULL : editorRowAt(E.cy);
 
 
     switch (key) {
     case ARROW_LEFT:
         if(E.cx != 0){
-            E.cx--;
+            E.cx = editorRowPrevCx(row, E.cx);
         } 
         else if(E.cy > 0){
             E.cy--;
-            E.cx = E.row[E.cy].size;
+            E.cx = editorRowAt(E.cy) -> size;
         }
         break;
     case ARROW_RIGHT:
         if(row && E.cx < row -> size){
-            E.cx++;
+            E.cx = editorRowNextCx(row, E.cx);
         }
         else if(row && E.cx == row -> size){
             E.cy++;
@@ -34,11 +34,13 @@ void editorMoveCursor(int key){
             E.cy++;
         break;
     }
-    row = (E.cy >= E.numRows) ? NULL : &E.row[E.cy];
+    row = (E.cy >= E.numRows) ? NULL : editorRowAt(E.cy);
     int rowLen = row ? row -> size : 0;
     if(E.cx > rowLen){
         E.cx = rowLen;
     }
+    /* Never leave the cursor inside a character. */
+    if(row) E.cx = editorRowSnapCx(row, E.cx);
 }
 
 void editorProcessKeypress(){
@@ -60,7 +62,7 @@ void editorProcessKeypress(){
                 return;
             }
 
-
+            editorJournalClose(1);
             write(STDOUT_FILENO, "\x1b[2J", 4);
             write(STDOUT_FILENO, "\x1b[H", 3);
             exit(0);
@@ -70,7 +72,7 @@ void editorProcessKeypress(){
             break;
         case END_KEY:
             if(E.cy < E.numRows){
-                E.cx = E.row[E.cy].size;
+                E.cx = editorRowAt(E.cy) -> size;
             }
             break;
 
@@ -78,7 +80,13 @@ void editorProcessKeypress(){
             case CTRL_KEY('h'):
             case DEL_KEY:
                 if(c == DEL_KEY) editorMoveCursor(ARROW_RIGHT);
-                editorDelChar();
+                /* A character and its combining marks go at once, one
+                   byte at a time. */
+                if(E.cy < E.numRows && E.cx > 0){
+                    int n = E.cx - editorRowPrevCx(editorRowAt(E.cy), E.cx);
+                    while(n--) editorDelChar();
+                }
+                else editorDelChar();
                 break;
 
 
@@ -106,9 +114,21 @@ void editorProcessKeypress(){
             editorFind();
             break;
 
+        case CTRL_KEY('r'):
+            editorReplaceAll();
+            break;
+
         case CTRL_KEY('s'):
             editorSave();
             break;
+
+        case CTRL_KEY('z'):
+            editorUndo();
+            break;
+
+        case CTRL_KEY('y'):
+            editorRedo();
+            break;
         case ARROW_UP:
         case ARROW_LEFT:
         case ARROW_DOWN:
@@ -117,8 +137,26 @@ void editorProcessKeypress(){
             break;
 
         case CTRL_KEY('l'):
+            editorInvalidateFrame();
+            break;
+
+        case CTRL_KEY('p'):
+            editorTraceToggleOverlay();
+            break;
+
         case '\x1b':
             break;
+
+        case WAKE_KEY:
+            return;
+
+        case PASTE_KEY:
+            {
+                size_t len;
+                char *text = editorPasteText(&len);
+                editorInsertText(text, len);
+            }
+            break;
         
         default:
             editorInsertChar(c);
@@ -136,12 +174,14 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)){
 
     while(1){
         editorSetStatusMessage(prompt, buf);
-        editorRefreshScreen();
+        if(!editorInputPending()) editorRefreshScreen();
 
         int c = editorReadKey();
 
         if(c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE){
-            if(bufLen != 0) buf[--bufLen] = '\0';
+            /* Remove a whole UTF-8 sequence. */
+            while(bufLen != 0 && ((unsigned char)buf[--bufLen] & 0xC0) == 0x80);
+            buf[bufLen] = '\0';
         }
         else if(c == '\x1b'){
             editorSetStatusMessage("");
@@ -156,7 +196,22 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)){
                 return buf;
             }
         }
-        else if(!iscntrl(c) && c < 128){
+        else if(c == PASTE_KEY){
+            /* A prompt holds one line: keep the printable part of the
+               pasted text up to its first line break. */
+            size_t len, i;
+            char *text = editorPasteText(&len);
+            for(i = 0; i < len && text[i] != '\n'; ++i){
+                if(iscntrl((unsigned char)text[i])) continue;
+                if(bufLen == bufSize - 1){
+                    bufSize *= 2;
+                    buf = realloc(buf, bufSize);
+                }
+                buf[bufLen++] = text[i];
+            }
+            buf[bufLen] = '\0';
+        }
+        else if(c < 256 && !iscntrl(c)){
             if(bufLen == bufSize - 1){
                 bufSize *= 2;
                 buf = realloc(buf, bufSize);
@@ -0,0 +1,369 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** edit journal ***/
+
+/* Every buffer edit is appended as a compact binary record to
+   "<file>.journal", so a crash loses at most the last unflushed batch
+   instead of everything since the last save. Records are buffered in
+   memory and written with one write() when the buffer fills or the last
+   flush is JOURNAL_FLUSH_MS old; the key loop also flushes when input goes
+   idle. The journal starts with a header naming the exact file version it
+   applies to, so edits are only ever replayed onto that version. */
+
+#define JOURNAL_MAGIC "BJNL1\n"
+#define JOURNAL_MAGIC_LEN 6
+
+/* Record layout: op byte, row and column as LEB128 varints, then the
+   inserted byte for JNL_INSERT, the length and bytes for JNL_TEXT, the
+   end row and column for JNL_DELRANGE, or the replaced length and the
+   length and bytes of the replacement for JNL_REPLACE. A keystroke
+   typically costs 4-6 bytes. */
+enum { JNL_INSERT = 1, JNL_DELETE, JNL_SPLIT, JNL_JOIN, JNL_DELROW, JNL_TEXT, JNL_DELRANGE, JNL_REPLACE };
+
+/* Identity of the file version the journal applies to. */
+struct journalBase {
+    uint64_t dev, ino, size, mtimeSec, mtimeNsec;
+};
+
+static struct {
+    char *path;
+    int fd;
+    int failed;
+    int replaying;
+    struct journalBase base;
+    unsigned char buf[JOURNAL_BUF_BYTES];
+    size_t used;
+    struct timespec lastFlush;
+} journal = { .fd = -1 };
+
+static void journalStat(const char *fileName, struct journalBase *b){
+    struct stat st;
+    memset(b, 0, sizeof(*b));
+    if(stat(fileName, &st) == -1) return;
+    b -> dev = st.st_dev;
+    b -> ino = st.st_ino;
+    b -> size = st.st_size;
+    b -> mtimeSec = st.st_mtim.tv_sec;
+    b -> mtimeNsec = st.st_mtim.tv_nsec;
+}
+
+static long journalAgeMs(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - journal.lastFlush.tv_sec) * 1000 +
+           (now.tv_nsec - journal.lastFlush.tv_nsec) / 1000000;
+}
+
+/* Creates the journal file on first use, so buffers that are never edited
+   leave nothing behind. */
+static int journalCreate(){
+    if(journal.fd != -1) return 0;
+    if(journal.failed || journal.path == NULL) return -1;
+    int fd = open(journal.path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fd != -1){
+        if(write(fd, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) == JOURNAL_MAGIC_LEN &&
+           write(fd, &journal.base, sizeof(journal.base)) == sizeof(journal.base)){
+            journal.fd = fd;
+            return 0;
+        }
+        close(fd);
+        unlink(journal.path);
+    }
+    /* Journaling is best effort: a read-only directory must not stop
+       editing, it only loses crash protection. */
+    journal.failed = 1;
+    editorSetStatusMessage("Journal disabled: %s", strerror(errno));
+    return -1;
+}
+
+static void journalWrite(const void *data, size_t len){
+    const char *p = data;
+    while(len > 0){
+        ssize_t w = write(journal.fd, p, len);
+        if(w == -1){
+            if(errno == EINTR) continue;
+            return;
+        }
+        p += w;
+        len -= w;
+    }
+}
+
+void editorJournalFlush(){
+    clock_gettime(CLOCK_MONOTONIC, &journal.lastFlush);
+    if(journal.used == 0) return;
+    if(journalCreate() == -1){
+        journal.used = 0;
+        return;
+    }
+    journalWrite(journal.buf, journal.used);
+    journal.used = 0;
+}
+
+/* Milliseconds until buffered records are due to be written, 0 if they
+   are overdue, or -1 if nothing is buffered. */
+int editorJournalDueMs(){
+    if(journal.used == 0) return -1;
+    long left = JOURNAL_FLUSH_MS - journalAgeMs();
+    return left > 0 ? left : 0;
+}
+
+static unsigned char *putVarint(unsigned char *p, unsigned v){
+    while(v >= 0x80){
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+/* Starts a record in the buffer with room for its op byte, up to four
+   varints and one payload byte. */
+static unsigned char *journalBegin(int op){
+    if(journal.used + 22 > sizeof(journal.buf)) editorJournalFlush();
+    unsigned char *p = journal.buf + journal.used;
+    *p++ = op;
+    return p;
+}
+
+static void journalEnd(unsigned char *p){
+    journal.used = p - journal.buf;
+    if(journalAgeMs() >= JOURNAL_FLUSH_MS) editorJournalFlush();
+}
+
+static void journalRecord(int op, int row, int col, int c){
+    if(journal.replaying || journal.path == NULL) return;
+    unsigned char *p = journalBegin(op);
+    p = putVarint(p, row);
+    p = putVarint(p, col);
+    if(op == JNL_INSERT) *p++ = c;
+    journalEnd(p);
+}
+
+void editorJournalInsertChar(int row, int col, int c){
+    journalRecord(JNL_INSERT, row, col, c);
+}
+
+void editorJournalDelChar(int row, int col){
+    journalRecord(JNL_DELETE, row, col, 0);
+}
+
+void editorJournalSplit(int row, int col){
+    journalRecord(JNL_SPLIT, row, col, 0);
+}
+
+void editorJournalJoin(int row){
+    journalRecord(JNL_JOIN, row, 0, 0);
+}
+
+void editorJournalDelRow(int row){
+    journalRecord(JNL_DELROW, row, 0, 0);
+}
+
+/* Ends a record at p with the 'len' bytes of s. */
+static void journalEndText(unsigned char *p, const char *s, size_t len){
+    if(journal.buf + sizeof(journal.buf) - p >= (ptrdiff_t)len){
+        memcpy(p, s, len);
+        journalEnd(p + len);
+        return;
+    }
+    /* Too big for the buffer: flush the header and write the text
+       straight from the caller. */
+    journal.used = p - journal.buf;
+    editorJournalFlush();
+    if(journal.fd != -1) journalWrite(s, len);
+}
+
+void editorJournalInsertText(int row, int col, const char *s, size_t len){
+    if(journal.replaying || journal.path == NULL) return;
+    unsigned char *p = journalBegin(JNL_TEXT);
+    p = putVarint(p, row);
+    p = putVarint(p, col);
+    p = putVarint(p, len);
+    journalEndText(p, s, len);
+}
+
+/* The 'oldLen' bytes at (row, col) were replaced by the 'len' bytes of s,
+   which hold no line break. */
+void editorJournalReplace(int row, int col, int oldLen, const char *s, size_t len){
+    if(journal.replaying || journal.path == NULL) return;
+    unsigned char *p = journalBegin(JNL_REPLACE);
+    p = putVarint(p, row);
+    p = putVarint(p, col);
+    p = putVarint(p, oldLen);
+    p = putVarint(p, len);
+    journalEndText(p, s, len);
+}
+
+void editorJournalDelRange(int row, int col, int endRow, int endCol){
+    if(journal.replaying || journal.path == NULL) return;
+    unsigned char *p = journalBegin(JNL_DELRANGE);
+    p = putVarint(p, row);
+    p = putVarint(p, col);
+    p = putVarint(p, endRow);
+    p = putVarint(p, endCol);
+    journalEnd(p);
+}
+
+static int getVarint(const unsigned char **p, const unsigned char *end, int *v){
+    unsigned x = 0;
+    int shift;
+    for(shift = 0; shift < 35 && *p < end; shift += 7){
+        unsigned char b = *(*p)++;
+        x |= (unsigned)(b & 0x7f) << shift;
+        if(!(b & 0x80)){
+            if(x > INT_MAX) return -1;
+            *v = x;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Applies one record through the normal editing operations. Returns -1 on
+   a record that does not fit the buffer, which ends the replay. */
+static int journalApply(int op, int row, int col, int c, const unsigned char *text, int len){
+    if(row > E.numRows) return -1;
+    int size = row < E.numRows ? editorRowAt(row) -> size : 0;
+    if(col > size) return -1;
+    E.cy = row;
+    E.cx = col;
+    switch(op){
+        case JNL_INSERT:
+            editorInsertChar(c);
+            break;
+        case JNL_DELETE:
+            if(row == E.numRows || col >= size) return -1;
+            E.cx = col + 1;
+            editorDelChar();
+            break;
+        case JNL_SPLIT:
+            editorInsertNewline();
+            break;
+        case JNL_JOIN:
+            if(row == 0 || row == E.numRows) return -1;
+            E.cx = 0;
+            editorDelChar();
+            break;
+        case JNL_DELROW:
+            if(row == E.numRows || size != 0) return -1;
+            editorDelRow(row);
+            break;
+        case JNL_TEXT:
+            editorInsertText((const char *)text, len);
+            break;
+        case JNL_DELRANGE:
+            /* For this record 'c' is the end row and 'len' the end column. */
+            if(c < row || c >= E.numRows || (c == row && len < col)) return -1;
+            if(len > editorRowAt(c) -> size) return -1;
+            editorDelRange(row, col, c, len);
+            break;
+        case JNL_REPLACE:
+            /* 'c' is the replaced length. */
+            if(row == E.numRows || c > size - col) return -1;
+            editorRowDelRange(editorRowAt(row), col, c);
+            editorRowInsertString(editorRowAt(row), col, (const char *)text, len);
+            editorSyntaxTouch(row);
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+/* Replays the records in [p, end) and returns how many bytes were valid. */
+static size_t journalReplay(const unsigned char *p, const unsigned char *end, int *count){
+    const unsigned char *start = p;
+    const unsigned char *good = p;
+    *count = 0;
+    while(p < end){
+        int op = *p++;
+        int row, col, c = 0, len = 0;
+        const unsigned char *text = NULL;
+        if(getVarint(&p, end, &row) == -1 || getVarint(&p, end, &col) == -1) break;
+        if(op == JNL_INSERT){
+            if(p == end) break;
+            c = *p++;
+        }
+        else if(op == JNL_TEXT){
+            if(getVarint(&p, end, &len) == -1 || end - p < len) break;
+            text = p;
+            p += len;
+        }
+        else if(op == JNL_DELRANGE){
+            if(getVarint(&p, end, &c) == -1 || getVarint(&p, end, &len) == -1) break;
+        }
+        else if(op == JNL_REPLACE){
+            if(getVarint(&p, end, &c) == -1 || getVarint(&p, end, &len) == -1 || end - p < len) break;
+            text = p;
+            p += len;
+        }
+        if(journalApply(op, row, col, c, text, len) == -1) break;
+        good = p;
+        (*count)++;
+    }
+    return good - start;
+}
+
+/* Starts journaling edits of fileName. If a journal for the same version
+   of the file is left over from a crash, its edits are replayed onto the
+   freshly loaded buffer and journaling continues in that file. */
+void editorJournalOpen(const char *fileName){
+    editorJournalClose(0);
+    size_t len = strlen(fileName);
+    journal.path = malloc(len + 9);
+    if(journal.path == NULL) die("malloc");
+    memcpy(journal.path, fileName, len);
+    memcpy(journal.path + len, ".journal", 9);
+    journalStat(fileName, &journal.base);
+    clock_gettime(CLOCK_MONOTONIC, &journal.lastFlush);
+
+    int fd = open(journal.path, O_RDWR | O_APPEND);
+    if(fd == -1) return;
+    struct stat st;
+    size_t head = JOURNAL_MAGIC_LEN + sizeof(struct journalBase);
+    unsigned char *data = NULL;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= head){
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) data = NULL;
+    }
+    if(data == NULL || memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0 ||
+       memcmp(data + JOURNAL_MAGIC_LEN, &journal.base, sizeof(journal.base)) != 0){
+        /* Written against another version of the file: its offsets mean
+           nothing here, so it is overwritten by the first flush. */
+        if(data) munmap(data, st.st_size);
+        close(fd);
+        editorSetStatusMessage("Ignoring stale journal %s", journal.path);
+        return;
+    }
+
+    int count;
+    journal.replaying = 1;
+    size_t good = journalReplay(data + head, data + st.st_size, &count);
+    journal.replaying = 0;
+    munmap(data, st.st_size);
+    /* Drop a torn record left by the crash so new records follow the
+       last good one. */
+    if(ftruncate(fd, head + good) == -1){
+        close(fd);
+        journal.failed = 1;
+        return;
+    }
+    journal.fd = fd;
+    if(count > 0) editorSetStatusMessage("Recovered %d edits from %s", count, journal.path);
+}
+
+/* Closes the journal; with discard set the file is removed as well, as
+   after a save or a deliberate quit. */
+void editorJournalClose(int discard){
+    if(!discard) editorJournalFlush();
+    journal.used = 0;
+    if(journal.fd != -1) close(journal.fd);
+    journal.fd = -1;
+    journal.failed = 0;
+    if(discard && journal.path) unlink(journal.path);
+    free(journal.path);
+    journal.path = NULL;
+}
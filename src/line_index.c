@@ -0,0 +1,178 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define LINE_INDEX_X86 1
+#include <immintrin.h>
+#endif
+
+/*** line index ***/
+
+/* editorIndexLines() splits a mapped file into LINE_CHUNK_BYTES chunks and
+   scans them for '\n' on the worker pool. Each chunk keeps the newline
+   offsets relative to its own start; once every chunk is done the chunks
+   are stitched together in file order and handed to the line store in one
+   bulk load. */
+
+/* Newline offsets fit in 31 bits; the top bit marks a "\r\n" ending so
+   the '\r' never has to be re-read once the chunk's pages are dropped. */
+#define NL_CR 0x80000000u
+
+typedef struct lineChunk {
+    size_t start;
+    size_t end;
+    uint32_t *nl;
+    int count;
+    int cap;
+} lineChunk;
+
+typedef struct lineScan {
+    char *map;
+    size_t len;
+    lineChunk *chunks;
+    int nChunks;
+    int useAvx2;
+} lineScan;
+
+static void chunkPush(lineChunk *c, const char *p, size_t off){
+    if(c -> count == c -> cap){
+        c -> cap = c -> cap ? c -> cap * 2 : 4096;
+        c -> nl = realloc(c -> nl, sizeof(uint32_t) * c -> cap);
+        if(c -> nl == NULL) die("realloc");
+    }
+    uint32_t entry = off;
+    /* p[-1] is the last byte of the previous chunk when this is not the first. */
+    if((off > 0 || c -> start > 0) && p[(ptrdiff_t)off - 1] == '\r') entry |= NL_CR;
+    c -> nl[c -> count++] = entry;
+}
+
+static void scanScalar(const char *p, size_t from, size_t len, lineChunk *c){
+    const char *hit;
+    while(from < len && (hit = memchr(p + from, '\n', len - from)) != NULL){
+        chunkPush(c, p, hit - p);
+        from = hit - p + 1;
+    }
+}
+
+#ifdef LINE_INDEX_X86
+static void scanSse2(const char *p, size_t len, lineChunk *c){
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        while(mask){
+            chunkPush(c, p, i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    scanScalar(p, i, len, c);
+}
+
+__attribute__((target("avx2")))
+static void scanAvx2(const char *p, size_t len, lineChunk *c){
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for(; i + 64 <= len; i += 64){
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + 32));
+        uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, nl));
+        mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, nl)) << 32;
+        while(mask){
+            chunkPush(c, p, i + __builtin_ctzll(mask));
+            mask &= mask - 1;
+        }
+    }
+    scanScalar(p, i, len, c);
+}
+#endif
+
+static void scanChunk(int task, void *arg){
+    lineScan *s = arg;
+    lineChunk *c = &s -> chunks[task];
+    const char *p = s -> map + c -> start;
+    size_t len = c -> end - c -> start;
+
+#ifdef LINE_INDEX_X86
+    if(s -> useAvx2) scanAvx2(p, len, c);
+    else scanSse2(p, len, c);
+#else
+    scanScalar(p, 0, len, c);
+#endif
+
+    /* Hand the scanned pages back; rows fault them in again on use. */
+    size_t pageMask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+    uintptr_t from = ((uintptr_t)p + pageMask) & ~(uintptr_t)pageMask;
+    uintptr_t to = ((uintptr_t)p + len) & ~(uintptr_t)pageMask;
+    if(to > from) madvise((void *)from, to - from, MADV_DONTNEED);
+}
+
+/* Walks the chunks in order and yields one mapped row per line. */
+typedef struct lineCursor {
+    lineScan *scan;
+    int chunk;
+    int idx;
+    size_t lineStart;
+} lineCursor;
+
+static void fillRows(erow *rows, int count, void *arg){
+    lineCursor *cur = arg;
+    lineScan *s = cur -> scan;
+    int k;
+    for(k = 0; k < count; ++k){
+        while(cur -> chunk < s -> nChunks && cur -> idx == s -> chunks[cur -> chunk].count){
+            cur -> chunk++;
+            cur -> idx = 0;
+        }
+        size_t lineEnd = s -> len;
+        int cr = 0;
+        if(cur -> chunk < s -> nChunks){
+            lineChunk *c = &s -> chunks[cur -> chunk];
+            uint32_t entry = c -> nl[cur -> idx++];
+            lineEnd = c -> start + (entry & ~NL_CR);
+            cr = (entry & NL_CR) != 0;
+        }
+        else if(lineEnd > cur -> lineStart && s -> map[lineEnd - 1] == '\r'){
+            cr = 1;
+        }
+        char *line = s -> map + cur -> lineStart;
+        size_t lineLen = lineEnd - cur -> lineStart - cr;
+        editorRowInitMapped(&rows[k], line, lineLen);
+        cur -> lineStart = lineEnd + 1;
+    }
+}
+
+void editorIndexLines(char *map, size_t len){
+    lineScan s;
+    s.map = map;
+    s.len = len;
+    s.nChunks = (len + LINE_CHUNK_BYTES - 1) / LINE_CHUNK_BYTES;
+    s.chunks = calloc(s.nChunks ? s.nChunks : 1, sizeof(lineChunk));
+    if(s.chunks == NULL) die("calloc");
+#ifdef LINE_INDEX_X86
+    s.useAvx2 = __builtin_cpu_supports("avx2");
+#else
+    s.useAvx2 = 0;
+#endif
+    int i;
+    for(i = 0; i < s.nChunks; ++i){
+        s.chunks[i].start = (size_t)i * LINE_CHUNK_BYTES;
+        s.chunks[i].end = s.chunks[i].start + LINE_CHUNK_BYTES;
+        if(s.chunks[i].end > len) s.chunks[i].end = len;
+    }
+
+    editorPoolRun(s.nChunks, scanChunk, &s);
+
+    size_t lines = 0;
+    for(i = 0; i < s.nChunks; ++i) lines += s.chunks[i].count;
+    if(len > 0 && map[len - 1] != '\n') lines++;
+    if(lines > INT_MAX) die("too many lines");
+
+    lineCursor cur = {&s, 0, 0, 0};
+    editorRowStoreLoad(lines, fillRows, &cur);
+    E.numRows = lines;
+
+    for(i = 0; i < s.nChunks; ++i) free(s.chunks[i].nl);
+    free(s.chunks);
+}
@@ -10,8 +10,11 @@ void initEditor(){
     E.rx = 0;
     E.numRows = 0;
     E.dirty = 0;
-    E.row = NULL;
+    E.rows.root = NULL;
+    E.rows.height = 0;
     E.fileName = NULL;
+    E.map = NULL;
+    E.mapLen = 0;
     E.statusMsg[0] = '\0';
     E.statusMsgTime = 0;
     if(getWindowSize(&E.screenRows, &E.screenCols) == -1){
@@ -21,18 +24,33 @@ void initEditor(){
     
 }
 
+static long msSince(const struct timespec *t0){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t0 -> tv_sec) * 1000 + (now.tv_nsec - t0 -> tv_nsec) / 1000000;
+}
+
 int main(int argc, char *argv[]){
+    /* B_TRACE=file.json writes the trace ring to file.json on exit. */
+    char *trace = getenv("B_TRACE");
+    if(trace && *trace) editorTraceDumpAtExit(trace);
     enableRawMode();
     initEditor();
+    editorSetStatusMessage("HELP: ^S save | ^Q quit | ^F find | ^R replace | ^Z undo | ^Y redo");
     if(argc >= 2){
         editorOpen(argv[1]);
     }
 
-    editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
-
     while(1){
         editorRefreshScreen();
         editorProcessKeypress();
+        /* Keys that arrived in the same burst are applied before the next
+           frame, so key repeat cannot outrun the terminal. */
+        struct timespec burst;
+        clock_gettime(CLOCK_MONOTONIC, &burst);
+        while(editorInputPending() && msSince(&burst) < FRAME_DEADLINE_MS){
+            editorProcessKeypress();
+        }
     }
     return 0;
 }
\ No newline at end of file
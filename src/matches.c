@@ -0,0 +1,467 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** search queries ***/
+
+static int editorQueryCompile(searchQuery *q, const char *text, int icase, int regex, const char **error){
+    memset(q, 0, sizeof(*q));
+    q -> text = strdup(text);
+    if(q -> text == NULL) die("strdup");
+    q -> icase = icase;
+    q -> regex = regex;
+    *error = NULL;
+    if(!regex){
+        editorPatternInit(&q -> pattern, text, icase);
+        q -> ok = q -> pattern.len > 0;
+        return q -> ok ? 0 : -1;
+    }
+    if(text[0] == '\0') return -1;
+    if(editorRegexCompile(&q -> rev, text, icase, 1, error) != 0) return -1;
+    if(editorRegexCompile(&q -> fwd, text, icase, 0, error) != 0){
+        editorRegexFree(&q -> rev);
+        return -1;
+    }
+    editorDfaInit(&q -> revDfa, &q -> rev, 0);
+    editorDfaInit(&q -> fwdDfa, &q -> fwd, 1);
+    q -> ok = 1;
+    return 0;
+}
+
+static void editorQueryFree(searchQuery *q){
+    if(q -> text == NULL) return;
+    if(!q -> regex) editorPatternFree(&q -> pattern);
+    else if(q -> ok){
+        editorDfaFree(&q -> revDfa);
+        editorDfaFree(&q -> fwdDfa);
+        editorRegexFree(&q -> rev);
+        editorRegexFree(&q -> fwd);
+    }
+    free(q -> text);
+    memset(q, 0, sizeof(*q));
+}
+
+/*** match set ***/
+
+/* While the search prompt is open, every match of the current query is
+   kept here in (row, col) order. The set is filled in the background:
+   the buffer is cut into SEARCH_TASK_ROWS-row tasks that run on the
+   worker pool, each with its own compiled copy of the query, and finished
+   tasks are merged in row order on the input thread whenever a worker
+   wakes it. Typing cancels the running search cooperatively: tasks check
+   a flag between rows and bail out.
+
+   A literal query that grows by appending characters can only match where
+   the shorter one did, so a complete set is narrowed by re-checking its
+   positions instead of rescanning the buffer; that runs as a background
+   job too, with tasks over slices of the old set. Literal sets hold every
+   occurrence, overlapping ones included, which is what keeps narrowing
+   exact; regex sets hold leftmost-longest matches. Past MATCH_SET_MAX
+   positions the set is dropped and rows are scanned on demand instead.
+
+   The text does not change while the prompt is open, so workers read
+   rows without locking. The prompt still redraws the screen, which
+   renders and indexes the visible rows and updates their syntax states;
+   that only writes fields workers never read (viewFlags, the render
+   buffer or column index, hlState), never flags or the text itself. */
+
+#define NARROW_TASK_MATCHES 16384
+
+struct matchList {
+    matchPos *pos;
+    int n;
+    int cap;
+};
+
+/* A compiled query plus its scratch space; one per thread. */
+typedef struct matcher {
+    searchQuery q;
+    char *hits;
+    int hitsCap;
+} matcher;
+
+struct searchTask {
+    struct matchList found;
+    int done;
+};
+
+static struct {
+    struct matchList set;
+    struct matchList scratch;
+    matcher main;
+    int active;
+    int overflow;
+    int curRow;
+    int curCol;
+} matches;
+
+static struct {
+    struct searchTask *tasks;
+    int nTasks;
+    int narrowing;
+    struct matchList source;
+    int merged;
+    int running;
+    int cancel;
+    int found;
+    pthread_mutex_t lock;
+    matcher *idle[POOL_MAX_THREADS + 1];
+    int nIdle;
+} job = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static int listPush(struct matchList *l, int row, int col, int len){
+    if(l -> n == l -> cap){
+        l -> cap = l -> cap ? l -> cap * 2 : 256;
+        l -> pos = realloc(l -> pos, sizeof(matchPos) * l -> cap);
+        if(l -> pos == NULL) die("realloc");
+    }
+    l -> pos[l -> n].row = row;
+    l -> pos[l -> n].col = col;
+    l -> pos[l -> n].len = len;
+    return ++l -> n;
+}
+
+/* Appends the matches of row 'at' that start at or after column 'from'. */
+static void collectRow(matcher *m, int at, int from, struct matchList *l){
+    searchQuery *q = &m -> q;
+    erow *row = editorRowAt(at);
+    if(!q -> regex){
+        int col = from;
+        while((col = editorSearchRow(&q -> pattern, row, col)) >= 0){
+            listPush(l, at, col, q -> pattern.len);
+            col++;
+        }
+        return;
+    }
+
+    if(row -> size + 1 > m -> hitsCap){
+        m -> hitsCap = row -> size + 1;
+        m -> hits = realloc(m -> hits, m -> hitsCap);
+        if(m -> hits == NULL) die("realloc");
+    }
+    if(editorRegexStarts(&q -> revDfa, row, m -> hits) == 0) return;
+    int col;
+    for(col = from; col <= row -> size; ++col){
+        if(!m -> hits[col]) continue;
+        int end = editorRegexMatchEnd(&q -> fwdDfa, row, col);
+        if(end < col) end = col;
+        listPush(l, at, col, end - col);
+        if(end > col) col = end - 1;
+    }
+}
+
+static void matcherFree(matcher *m){
+    editorQueryFree(&m -> q);
+    free(m -> hits);
+    m -> hits = NULL;
+    m -> hitsCap = 0;
+}
+
+/*** background search ***/
+
+static int jobCancelled(){
+    return __atomic_load_n(&job.cancel, __ATOMIC_ACQUIRE);
+}
+
+/* Takes an idle matcher for the current query, compiling a new one if
+   every existing one is busy. */
+static matcher *jobMatcher(){
+    matcher *m = NULL;
+    pthread_mutex_lock(&job.lock);
+    if(job.nIdle > 0) m = job.idle[--job.nIdle];
+    pthread_mutex_unlock(&job.lock);
+    if(m == NULL){
+        const char *error;
+        m = calloc(1, sizeof(matcher));
+        if(m == NULL) die("calloc");
+        editorQueryCompile(&m -> q, matches.main.q.text, matches.main.q.icase,
+                           matches.main.q.regex, &error);
+    }
+    return m;
+}
+
+static void jobRelease(matcher *m){
+    pthread_mutex_lock(&job.lock);
+    job.idle[job.nIdle++] = m;
+    pthread_mutex_unlock(&job.lock);
+}
+
+/* Keeps the positions of one slice of the previous set where the grown
+   query still matches. */
+static void narrowTaskRun(struct searchTask *t, int task){
+    matcher *m = jobMatcher();
+    searchPattern *p = &m -> q.pattern;
+    int i = task * NARROW_TASK_MATCHES;
+    int end = i + NARROW_TASK_MATCHES < job.source.n ? i + NARROW_TASK_MATCHES : job.source.n;
+    int rowIdx = -1;
+    erow *row = NULL;
+    for(; i < end; ++i){
+        matchPos pos = job.source.pos[i];
+        if(pos.row != rowIdx){
+            if(jobCancelled()) break;
+            rowIdx = pos.row;
+            row = editorRowAt(rowIdx);
+        }
+        if(editorPatternMatchAt(p, row, pos.col)) listPush(&t -> found, pos.row, pos.col, p -> len);
+    }
+    __atomic_add_fetch(&job.found, t -> found.n, __ATOMIC_RELAXED);
+    jobRelease(m);
+}
+
+static void searchTaskRun(int task, void *arg){
+    (void)arg;
+    struct searchTask *t = &job.tasks[task];
+    if(job.narrowing){
+        if(!jobCancelled()) narrowTaskRun(t, task);
+        __atomic_store_n(&t -> done, 1, __ATOMIC_RELEASE);
+        editorWake();
+        return;
+    }
+    int at = task * SEARCH_TASK_ROWS;
+    int end = at + SEARCH_TASK_ROWS < E.numRows ? at + SEARCH_TASK_ROWS : E.numRows;
+    if(!jobCancelled()){
+        matcher *m = jobMatcher();
+        while(at < end && !jobCancelled()){
+            int col = 0;
+            /* Literal misses are skipped by the vectorized forward scan. */
+            if(!m -> q.regex){
+                at = editorSearchForward(&m -> q.pattern, at, 0, end, &col);
+                if(at < 0) break;
+            }
+            int before = t -> found.n;
+            collectRow(m, at, col, &t -> found);
+            int total = __atomic_add_fetch(&job.found, t -> found.n - before, __ATOMIC_RELAXED);
+            if(total > MATCH_SET_MAX) __atomic_store_n(&job.cancel, 1, __ATOMIC_RELEASE);
+            at++;
+        }
+        jobRelease(m);
+    }
+    __atomic_store_n(&t -> done, 1, __ATOMIC_RELEASE);
+    editorWake();
+}
+
+/* Stops the running search, if any, and frees its state. */
+static void jobStop(){
+    if(!job.running) return;
+    __atomic_store_n(&job.cancel, 1, __ATOMIC_RELEASE);
+    editorPoolWait();
+    int i;
+    for(i = job.merged; i < job.nTasks; ++i) free(job.tasks[i].found.pos);
+    free(job.tasks);
+    job.tasks = NULL;
+    for(i = 0; i < job.nIdle; ++i){
+        matcherFree(job.idle[i]);
+        free(job.idle[i]);
+    }
+    job.nIdle = 0;
+    job.running = 0;
+}
+
+/* Starts filling the set from scratch, or, when narrowing, from the
+   positions currently in it. */
+static void jobStart(int narrow){
+    job.narrowing = narrow;
+    job.source.n = 0;
+    if(narrow){
+        struct matchList old = matches.set;
+        matches.set = job.source;
+        job.source = old;
+        job.nTasks = (job.source.n + NARROW_TASK_MATCHES - 1) / NARROW_TASK_MATCHES;
+    }
+    else job.nTasks = (E.numRows + SEARCH_TASK_ROWS - 1) / SEARCH_TASK_ROWS;
+    matches.set.n = 0;
+    job.tasks = calloc(job.nTasks ? job.nTasks : 1, sizeof(struct searchTask));
+    if(job.tasks == NULL) die("calloc");
+    job.merged = 0;
+    job.cancel = 0;
+    job.found = 0;
+    job.running = 1;
+    editorPoolStart(job.nTasks, searchTaskRun, NULL);
+}
+
+/* Merges finished tasks into the set, in row order. */
+static void jobCollect(){
+    if(!job.running) return;
+    while(job.merged < job.nTasks &&
+          __atomic_load_n(&job.tasks[job.merged].done, __ATOMIC_ACQUIRE)){
+        struct matchList *found = &job.tasks[job.merged].found;
+        if(matches.set.n + found -> n > matches.set.cap){
+            matches.set.cap = matches.set.n + found -> n + matches.set.cap;
+            matches.set.pos = realloc(matches.set.pos, sizeof(matchPos) * matches.set.cap);
+            if(matches.set.pos == NULL) die("realloc");
+        }
+        if(found -> n){
+            memcpy(&matches.set.pos[matches.set.n], found -> pos, sizeof(matchPos) * found -> n);
+            matches.set.n += found -> n;
+        }
+        free(found -> pos);
+        job.merged++;
+    }
+    if(__atomic_load_n(&job.found, __ATOMIC_RELAXED) > MATCH_SET_MAX){
+        jobStop();
+        matches.overflow = 1;
+        matches.set.n = 0;
+    }
+    else if(job.merged == job.nTasks) jobStop();
+}
+
+/* Called when a worker wakes the input thread. */
+void editorMatchesPoll(){
+    jobCollect();
+}
+
+/*** queries over the set ***/
+
+void editorMatchesReset(){
+    jobStop();
+    matcherFree(&matches.main);
+    matches.active = 0;
+    matches.set.n = 0;
+    matches.overflow = 0;
+}
+
+/* Makes text the current query and brings the set up to date with it.
+   Returns -1 (with *error set for a bad regex) if there is nothing to
+   search for. */
+int editorMatchesSearch(const char *text, int icase, int regex, const char **error){
+    searchQuery *old = &matches.main.q;
+    *error = NULL;
+    jobCollect();
+    if(matches.active && old -> icase == icase && old -> regex == regex &&
+       strcmp(old -> text, text) == 0) return 0;
+
+    size_t oldLen = matches.active ? strlen(old -> text) : 0;
+    int narrow = matches.active && !job.running && !matches.overflow && !regex &&
+                 !old -> regex && old -> icase == icase &&
+                 strncmp(text, old -> text, oldLen) == 0;
+
+    jobStop();
+    matcherFree(&matches.main);
+    matches.curRow = -1;
+    if(editorQueryCompile(&matches.main.q, text, icase, regex, error) != 0){
+        matcherFree(&matches.main);
+        matches.active = 0;
+        matches.set.n = 0;
+        matches.overflow = 0;
+        return -1;
+    }
+    matches.active = 1;
+    matches.overflow = 0;
+    jobStart(narrow);
+    return 0;
+}
+
+static int posBefore(const matchPos *m, int row, int col){
+    return m -> row < row || (m -> row == row && m -> col < col);
+}
+
+/* Index of the first match at or after (row, col). */
+static int matchesLowerBound(int row, int col){
+    int lo = 0;
+    int hi = matches.set.n;
+    while(lo < hi){
+        int mid = lo + (hi - lo) / 2;
+        if(posBefore(&matches.set.pos[mid], row, col)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Scanning fallback for an overflowed set: the match after or before
+   (row, col) in row order, wrapping around the buffer. */
+static int matchesScanNext(int row, int col, int dir, matchPos *out){
+    int i;
+    for(i = 0; i <= E.numRows; ++i){
+        int at = dir > 0 ? row + i : row - i;
+        at = ((at % E.numRows) + E.numRows) % E.numRows;
+        matches.scratch.n = 0;
+        collectRow(&matches.main, at, 0, &matches.scratch);
+        int k;
+        if(dir > 0){
+            for(k = 0; k < matches.scratch.n; ++k){
+                if(i > 0 || matches.scratch.pos[k].col > col){
+                    *out = matches.scratch.pos[k];
+                    return 1;
+                }
+            }
+        } else {
+            for(k = matches.scratch.n - 1; k >= 0; --k){
+                if(i > 0 || matches.scratch.pos[k].col < col){
+                    *out = matches.scratch.pos[k];
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* The match after (dir > 0) or before (dir < 0) position (row, col),
+   wrapping around the buffer; pass row -1 for the first match. Returns 1
+   with *out set, 0 if there is no match, or -1 if the answer lies in
+   rows the background search has not reached yet. */
+int editorMatchesNext(int row, int col, int dir, matchPos *out){
+    if(!matches.active || E.numRows == 0) return 0;
+    jobCollect();
+    int found;
+    if(matches.overflow){
+        if(row < 0){
+            row = 0;
+            col = -1;
+        }
+        found = matchesScanNext(row, col, dir, out);
+    } else {
+        int n = matches.set.n;
+        int k;
+        if(row < 0) k = dir > 0 ? 0 : n - 1;
+        else if(dir > 0) k = matchesLowerBound(row, col + 1);
+        else k = matchesLowerBound(row, col) - 1;
+        /* Past the merged prefix (or wrapping round) needs the rest. */
+        if((k >= n || k < 0 || (row < 0 && dir < 0)) && job.running) return -1;
+        if(n == 0) return 0;
+        if(k >= n) k = 0;
+        if(k < 0) k = n - 1;
+        *out = matches.set.pos[k];
+        found = 1;
+    }
+    if(found){
+        matches.curRow = out -> row;
+        matches.curCol = out -> col;
+    }
+    return found;
+}
+
+/* Matches on row 'at', for highlighting. Returns their count and points
+   *out at the first. */
+int editorMatchesInRow(int at, matchPos **out){
+    if(!matches.active) return 0;
+    if(matches.overflow){
+        matches.scratch.n = 0;
+        collectRow(&matches.main, at, 0, &matches.scratch);
+        *out = matches.scratch.pos;
+        return matches.scratch.n;
+    }
+    int k = matchesLowerBound(at, 0);
+    int end = k;
+    while(end < matches.set.n && matches.set.pos[end].row == at) end++;
+    *out = &matches.set.pos[k];
+    return end - k;
+}
+
+/* Formats "match k of N" for the status bar; N is marked with "+" while
+   the background search is still counting. Returns 0 when no search is
+   active. */
+int editorMatchesStatus(char *buf, int size){
+    if(!matches.active) return 0;
+    if(matches.overflow) return snprintf(buf, size, "many matches");
+    int total = job.running ? __atomic_load_n(&job.found, __ATOMIC_RELAXED) : matches.set.n;
+    int k = 0;
+    if(matches.curRow >= 0){
+        int i = matchesLowerBound(matches.curRow, matches.curCol);
+        if(i < matches.set.n && matches.set.pos[i].row == matches.curRow &&
+           matches.set.pos[i].col == matches.curCol) k = i + 1;
+    }
+    if(total == 0 && !job.running) return snprintf(buf, size, "no matches");
+    if(k) return snprintf(buf, size, "match %d of %d%s", k, total, job.running ? "+" : "");
+    return snprintf(buf, size, "%d%s matches", total, job.running ? "+" : "");
+}
@@ -2,31 +2,110 @@
 #include "../include/data.h"
 #include "../include/prototypes.h"
 
-/*** append buffer ***/
-struct abuf {
-    char *b;
-    int len;
+/*** frame builder ***/
+
+/* A frame is a list of iovecs flushed with one writev(). Escape sequences,
+   padding and bar text are formatted into an arena that is sized once per
+   terminal size and reused by every frame; row text is referenced in place
+   from the render buffers. */
+struct frame {
+    struct iovec *iov;
+    int iovCnt;
+    int iovCap;
+    char *arena;
+    int arenaLen;
+    int arenaCap;
+    int bytes;
 };
 
-#define ABUF_INIT {NULL, 0}
+static struct frame fb = {NULL, 0, 0, NULL, 0, 0, 0};
+
+static void frameReserve(int lines, int cols){
+    /* Per line: position, attribute on/off, content and erase; the iovec
+       list grows if highlighting splits lines further. The arena holds a
+       line of text and up to two of highlight (per column and per byte)
+       per screen line. */
+    fb.iovCap = lines * 6 + 8;
+    fb.arenaCap = lines * (3 * SCREEN_LINE_BYTES(cols) + 48) + 256;
+    free(fb.iov);
+    free(fb.arena);
+    fb.iov = malloc(sizeof(struct iovec) * fb.iovCap);
+    fb.arena = malloc(fb.arenaCap);
+    if(fb.iov == NULL || fb.arena == NULL) die("malloc");
+}
+
+/* References len bytes at s until the frame is flushed. Consecutive
+   pieces that are adjacent in memory share one iovec; the first iovec is
+   never extended so that a frame can be flushed without it. */
+static void frameRef(const char *s, int len){
+    if(len <= 0) return;
+    fb.bytes += len;
+    if(fb.iovCnt > 1){
+        struct iovec *last = &fb.iov[fb.iovCnt - 1];
+        if((char *)last -> iov_base + last -> iov_len == s){
+            last -> iov_len += len;
+            return;
+        }
+    }
+    if(fb.iovCnt == fb.iovCap){
+        fb.iovCap *= 2;
+        fb.iov = realloc(fb.iov, sizeof(struct iovec) * fb.iovCap);
+        if(fb.iov == NULL) die("realloc");
+    }
+    fb.iov[fb.iovCnt].iov_base = (void *)s;
+    fb.iov[fb.iovCnt].iov_len = len;
+    fb.iovCnt++;
+}
+
+/* Reserves len bytes of arena to be filled in by the caller. */
+static char *frameAlloc(int len){
+    if(fb.arenaLen + len > fb.arenaCap) die("frame");
+    char *p = &fb.arena[fb.arenaLen];
+    fb.arenaLen += len;
+    return p;
+}
 
-void abAppend(struct abuf *ab, const char *s, int len){
-    char *new = realloc(ab->b, ab->len + len);
-    if(new == NULL) return;
-    memcpy(&new[ab->len], s, len);
-    ab->b = new;
-    ab->len += len;
+static void framePrintf(const char *fmt, ...){
+    va_list ap;
+    va_start(ap, fmt);
+    int room = fb.arenaCap - fb.arenaLen;
+    int len = vsnprintf(&fb.arena[fb.arenaLen], room, fmt, ap);
+    va_end(ap);
+    if(len < 0 || len >= room) die("frame");
+    frameRef(frameAlloc(len), len);
 }
 
-void abFree(struct abuf *ab){
-    free(ab->b);
+static void frameFlush(int from){
+    TRACE_BEGIN(write);
+    struct iovec *iov = &fb.iov[from];
+    int cnt = fb.iovCnt - from;
+    while(cnt > 0){
+        ssize_t n = writev(STDOUT_FILENO, iov, cnt < IOV_MAX ? cnt : IOV_MAX);
+        if(n == -1){
+            if(errno == EINTR) continue;
+            break;
+        }
+        while(cnt > 0 && (size_t)n >= iov -> iov_len){
+            n -= iov -> iov_len;
+            iov++;
+            cnt--;
+        }
+        if(cnt > 0){
+            iov -> iov_base = (char *)iov -> iov_base + n;
+            iov -> iov_len -= n;
+        }
+    }
+    fb.iovCnt = 0;
+    fb.arenaLen = 0;
+    TRACE_END(write);
 }
 
 /*** output operations ***/
 void editorScroll(){
+    TRACE_BEGIN(editorScroll);
     E.rx = 0;
     if(E.cy < E.numRows){
-        E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+        E.rx = editorRowCxToRx(editorRowAt(E.cy), E.cx);
     }
     if(E.cy < E.rowOff){
         E.rowOff = E.cy;
@@ -40,98 +119,320 @@ void editorScroll(){
     if(E.rx >= E.colOff + E.screenCols){
         E.colOff = E.rx - E.screenCols + 1;
     }
+    TRACE_END(editorScroll);
+}
+
+/*** frame shadow ***/
+
+/* The last frame sent to the terminal, one line per screen row. A new
+   frame is compared against it line by line and only lines (or, for plain
+   ASCII text lines, the span of columns) that changed are written out.
+   Each byte also carries a highlight class (HL_*), compared like the
+   text. */
+struct shadowLine {
+    char *b;
+    unsigned char *hl;
+    int len;
+    int plain;
+};
+
+static struct {
+    struct shadowLine *lines;
+    char *text;
+    unsigned char *hl;
+    int rows;
+    int cols;
+    int full;
+} shadow = {NULL, NULL, NULL, 0, 0, 1};
+
+/* A screen line's content: a slice of a render buffer, of the status
+   message, or of the frame arena, with per-column highlight classes (or
+   NULL when the line has none). */
+struct lineRef {
+    const char *b;
+    int len;
+    const unsigned char *hl;
+};
+
+static const char *hlSgr[] = {
+    [HL_NORMAL] = "",
+    [HL_COMMENT] = "\x1b[36m",
+    [HL_KEYWORD1] = "\x1b[33m",
+    [HL_KEYWORD2] = "\x1b[32m",
+    [HL_STRING] = "\x1b[35m",
+    [HL_NUMBER] = "\x1b[31m",
+    [HL_MATCH] = "\x1b[7m"
+};
+
+static int hlAt(const unsigned char *hl, int i){
+    return hl ? hl[i] : HL_NORMAL;
+}
+
+void editorInvalidateFrame(){
+    shadow.full = 1;
 }
 
-static void editorDrawRows(struct abuf *ab){
+static void editorShadowResize(int rows, int cols){
+    free(shadow.lines);
+    free(shadow.text);
+    free(shadow.hl);
+    shadow.lines = calloc(rows, sizeof(struct shadowLine));
+    size_t lineBytes = SCREEN_LINE_BYTES(cols);
+    shadow.text = malloc(rows * lineBytes);
+    shadow.hl = malloc(rows * lineBytes);
+    if(shadow.lines == NULL || shadow.text == NULL || shadow.hl == NULL) die("malloc");
     int y;
-    for(y = 0; y < E.screenRows; ++y){
-        int fileRow = y + E.rowOff;
-        if(fileRow >= E.numRows) {
-            if(E.numRows == 0 && y == E.screenRows / 3){
-                char welcome[80];
-                int welcomeLen = snprintf(welcome, sizeof(welcome), "B-textEditor --Version %s", B_TEXTEDITOR_VERSION);
-                if(welcomeLen > E.screenCols) welcomeLen = E.screenCols;
-                int padding = (E.screenCols - welcomeLen) / 2;
-                if(padding){
-                    abAppend(ab, "~", 1);
-                    padding--;
-                }
-                while(padding--) abAppend(ab, " ", 1);
-                abAppend(ab, welcome, welcomeLen);
-            } else {
-                abAppend(ab, "~", 1);
-            }
-        } else {
-            int len = E.row[fileRow].rSize - E.colOff;
-            if(len < 0) len = 0;
-            if(len > E.screenCols) len = E.screenCols;
-            abAppend(ab, &E.row[fileRow].render[E.colOff], len);
+    for(y = 0; y < rows; ++y){
+        shadow.lines[y].b = &shadow.text[y * lineBytes];
+        shadow.lines[y].hl = &shadow.hl[y * lineBytes];
+    }
+    shadow.rows = rows;
+    shadow.cols = cols;
+    shadow.full = 1;
+    frameReserve(rows, cols);
+}
+
+/* Queues whatever part of screen line y differs from the shadow copy.
+   'attr' is an SGR sequence that applies to the whole line (or NULL), so
+   spans of a reverse-video bar can be patched like plain text. Returns 1
+   if anything was queued. */
+static int editorFlushLine(int y, struct lineRef line, const char *attr){
+    struct shadowLine *old = &shadow.lines[y];
+    /* Only where a byte is a column can a span be patched in place. */
+    int plain = line.len == 0 || (memchr(line.b, '\x1b', line.len) == NULL &&
+                                  editorUtf8Ascii(line.b, line.len));
+    int i;
+    if(!shadow.full && old -> len == line.len && old -> plain == plain &&
+       memcmp(old -> b, line.b, line.len) == 0){
+        for(i = 0; i < line.len && old -> hl[i] == hlAt(line.hl, i); ++i);
+        if(i == line.len) return 0;
+    }
+
+    int start = 0;
+    int end = line.len;
+    int clear = 1;
+    if(!shadow.full && plain && old -> plain){
+        while(start < old -> len && start < line.len && old -> b[start] == line.b[start] &&
+              old -> hl[start] == hlAt(line.hl, start)) start++;
+        if(line.len == old -> len){
+            while(end > start && old -> b[end - 1] == line.b[end - 1] &&
+                  old -> hl[end - 1] == hlAt(line.hl, end - 1)) end--;
         }
+        clear = line.len < old -> len;
+    }
+
+    framePrintf("\x1b[%d;%dH", y + 1, start + 1);
+    if(attr) frameRef(attr, strlen(attr));
+    i = start;
+    while(i < end){
+        int h = hlAt(line.hl, i);
+        int run = i + 1;
+        while(run < end && hlAt(line.hl, run) == h) run++;
+        if(h != HL_NORMAL) frameRef(hlSgr[h], strlen(hlSgr[h]));
+        frameRef(&line.b[i], run - i);
+        if(h != HL_NORMAL) frameRef("\x1b[m", 3);
+        i = run;
+    }
+    if(attr) frameRef("\x1b[m", 3);
+    if(clear) frameRef("\x1b[K", 3);
+
+    memcpy(old -> b, line.b, line.len);
+    if(line.hl) memcpy(old -> hl, line.hl, line.len);
+    else memset(old -> hl, HL_NORMAL, line.len);
+    old -> len = line.len;
+    old -> plain = plain;
+    return 1;
+}
 
-        abAppend(ab, "\x1b[K", 3);
-       
-            abAppend(ab, "\r\n", 2);
+/* Spreads per-column highlight classes over the bytes of a rendered line
+   that is not plain ASCII: every byte of a character takes the class of
+   its first column, and a zero-width one that of the column before. */
+static const unsigned char *editorHighlightBytes(const unsigned char *colHl, int cols, struct lineRef line){
+    unsigned char *hl = (unsigned char *)frameAlloc(line.len);
+    int col = 0;
+    int i = 0;
+    while(i < line.len){
+        int cp;
+        int n = editorUtf8Decode(line.b + i, line.len - i, &cp);
+        int w = editorUtf8Width(cp);
+        int at = w ? col : col - 1;
+        if(at < 0) at = 0;
+        if(at >= cols) at = cols - 1;
+        memset(hl + i, colHl[at], n);
+        col += w;
+        i += n;
+    }
+    return hl;
+}
+
+/* Builds the highlight line of a file row covering the visible render
+   columns [E.colOff, E.colOff + len): its syntax classes, with the search
+   matches on it marked over them. */
+static const unsigned char *editorHighlightRow(erow *row, int fileRow, int len){
+    if(len <= 0) return NULL;
+    unsigned char *hl = (unsigned char *)frameAlloc(len);
+    int syntax = editorSyntaxRow(row, fileRow, E.colOff, len, hl);
+    matchPos *m;
+    int n = editorMatchesInRow(fileRow, &m);
+    if(n == 0) return syntax ? hl : NULL;
+    if(!syntax) memset(hl, HL_NORMAL, len);
+    /* Matches are sorted by column; only map the ones on screen, which
+       matters on a long row with many of them. */
+    int first = editorRowRxToCx(row, E.colOff);
+    int last = editorRowRxToCx(row, E.colOff + len);
+    int lo = 0, hi = n;
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if(m[mid].col + m[mid].len <= first) lo = mid + 1;
+        else hi = mid;
+    }
+    int k;
+    for(k = lo; k < n && m[k].col <= last; ++k){
+        int from = editorRowCxToRx(row, m[k].col) - E.colOff;
+        int to = editorRowCxToRx(row, m[k].col + m[k].len) - E.colOff;
+        if(from < 0) from = 0;
+        if(to > len) to = len;
+        if(from < to) memset(hl + from, HL_MATCH, to - from);
+    }
+    return hl;
+}
+
+static struct lineRef editorDrawRow(int y){
+    struct lineRef line = {"~", 1, NULL};
+    int fileRow = y + E.rowOff;
+    if(fileRow >= E.numRows) {
+        if(E.numRows == 0 && y == E.screenRows / 3){
+            char welcome[80];
+            int welcomeLen = snprintf(welcome, sizeof(welcome), "B-textEditor --Version %s", B_TEXTEDITOR_VERSION);
+            if(welcomeLen > E.screenCols) welcomeLen = E.screenCols;
+            int padding = (E.screenCols - welcomeLen) / 2;
+            char *p = frameAlloc(padding + welcomeLen);
+            line.b = p;
+            line.len = padding + welcomeLen;
+            if(padding){
+                *p++ = '~';
+                padding--;
+            }
+            memset(p, ' ', padding);
+            memcpy(p + padding, welcome, welcomeLen);
         }
-    
+    } else {
+        erow *row = editorRowAt(fileRow);
+        editorUpdateRow(row);
+        int len;
+        char *buf = frameAlloc(SCREEN_LINE_BYTES(E.screenCols));
+        line.b = editorRowRender(row, E.colOff, E.screenCols, buf, &len);
+        line.len = len;
+        /* Columns on screen; more or fewer than bytes outside ASCII. */
+        int cols = row -> rSize - E.colOff;
+        if(cols > E.screenCols) cols = E.screenCols;
+        line.hl = editorHighlightRow(row, fileRow, cols);
+        if(line.hl && !editorUtf8Ascii(line.b, line.len)){
+            line.hl = editorHighlightBytes(line.hl, cols, line);
+        }
+    }
+    return line;
 }
 
-void editorDrawStatusBar(struct abuf *ab){
-    abAppend(ab, "\x1b[7m", 4);
+static struct lineRef editorDrawStatusBar(){
     char status[80], rStatus[80];
     int len = snprintf(status, sizeof(status), "%.20s - %d lines %s", 
         E.fileName ? E.fileName : "[No Name]", E.numRows, 
     E.dirty ? "(modified)" : "");
-    int rLen = snprintf(rStatus, sizeof(rStatus), "%d/%d", E.cy + 1, E.numRows);
+    char search[40];
+    int rLen;
+    const char *fileType = editorSyntaxName();
+    if(editorMatchesStatus(search, sizeof(search)) > 0){
+        rLen = snprintf(rStatus, sizeof(rStatus), "%s | %d/%d", search, E.cy + 1, E.numRows);
+    } else if(fileType){
+        rLen = snprintf(rStatus, sizeof(rStatus), "%s | %d/%d", fileType, E.cy + 1, E.numRows);
+    } else {
+        rLen = snprintf(rStatus, sizeof(rStatus), "%d/%d", E.cy + 1, E.numRows);
+    }
     if(len > E.screenCols) len = E.screenCols;
-    abAppend(ab, status, len);
+    char *bar = frameAlloc(E.screenCols);
+    memcpy(bar, status, len);
     while(len < E.screenCols){
         if(E.screenCols - len == rLen){
-            abAppend(ab, rStatus, rLen);
+            memcpy(&bar[len], rStatus, rLen);
+            len += rLen;
             break;
         }
         else{
-            abAppend(ab, " ", 1);
-            len++;
+            bar[len++] = ' ';
         }
     }
-    abAppend(ab, "\x1b[m", 3);
-    abAppend(ab, "\r\n", 2);
-
+    struct lineRef line = {bar, len, NULL};
+    return line;
 }
 
-void editorDrawMessageBar(struct abuf *ab){
-    abAppend(ab, "\x1b[K", 3);
+/* The status message, with the perf overlay (if shown) at the right. */
+static struct lineRef editorDrawMessageBar(){
+    struct lineRef line = {E.statusMsg, 0, NULL};
     int msgLen = strlen(E.statusMsg);
-    if(msgLen > E.screenCols) msgLen = E.screenCols;
-    if(msgLen && time(NULL) - E.statusMsgTime < 5){
-        abAppend(ab, E.statusMsg, msgLen);
+    if(msgLen > E.screenCols){
+        msgLen = E.screenCols;
+        /* Do not cut a UTF-8 sequence in half. */
+        while(msgLen > 0 && (E.statusMsg[msgLen] & 0xC0) == 0x80) msgLen--;
+    }
+    if(msgLen && time(NULL) - E.statusMsgTime < STATUS_MSG_SECONDS){
+        line.len = msgLen;
     }
+    char perf[80];
+    int perfLen = editorTraceOverlay(perf, sizeof(perf));
+    if(perfLen > 0 && line.len + perfLen < E.screenCols){
+        char *bar = frameAlloc(E.screenCols);
+        memcpy(bar, E.statusMsg, line.len);
+        memset(bar + line.len, ' ', E.screenCols - line.len - perfLen);
+        memcpy(bar + E.screenCols - perfLen, perf, perfLen);
+        line.b = bar;
+        line.len = E.screenCols;
+    }
+    return line;
 }
 
 void editorRefreshScreen(){
-
+    TRACE_BEGIN(frame);
     editorScroll();
-    struct abuf ab = ABUF_INIT;
-
-    abAppend(&ab, "\x1b[?25l", 6);
-    abAppend(&ab, "\x1b[H", 3);
-    
-    editorDrawRows(&ab);
-    editorDrawStatusBar(&ab);
-    editorDrawMessageBar(&ab);
-    
-    char buf[32];
-    /* Fix: Logic to update cursor position relative to screen, not file */
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowOff) + 1, (E.rx - E.colOff) + 1);
-    abAppend(&ab, buf, strlen(buf));
+    int lines = E.screenRows + 2;
+    if(shadow.rows != lines || shadow.cols != E.screenCols){
+        editorShadowResize(lines, E.screenCols);
+    }
 
-    abAppend(&ab, "\x1b[?25h", 6);
+    /* Only the rows about to be drawn need their lexer states. */
+    editorSyntaxUpdate(E.rowOff + E.screenRows);
 
-    write(STDOUT_FILENO, ab.b, ab.len);
-    abFree(&ab);
+    fb.bytes = 0;
+    frameRef("\x1b[?25l", 6);
+    if(shadow.full) frameRef("\x1b[2J", 4);
+
+    int y;
+    int damaged = 0;
+    TRACE_BEGIN(drawRows);
+    for(y = 0; y < lines; ++y){
+        if(y < E.screenRows) damaged |= editorFlushLine(y, editorDrawRow(y), NULL);
+        else if(y == E.screenRows) damaged |= editorFlushLine(y, editorDrawStatusBar(), "\x1b[7m");
+        else damaged |= editorFlushLine(y, editorDrawMessageBar(), NULL);
+    }
+    shadow.full = 0;
+    TRACE_END(drawRows);
+
+    /* Fix: Logic to update cursor position relative to screen, not file */
+    framePrintf("\x1b[%d;%dH", (E.cy - E.rowOff) + 1, (E.rx - E.colOff) + 1);
+
+    /* Nothing changed but the cursor: skip hiding and showing it. */
+    if(damaged) frameRef("\x1b[?25h", 6);
+    else fb.bytes -= 6;
+    frameFlush(damaged ? 0 : 1);
+    TRACE_FRAME(frame, fb.bytes);
 }
 
 
+/* Bytes the last editorRefreshScreen() sent to the terminal. */
+int editorFrameBytes(){
+    return fb.bytes;
+}
+
 void editorSetStatusMessage(const char *fmt, ...){
     va_list ap;
     va_start(ap, fmt);
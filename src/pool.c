@@ -0,0 +1,100 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** worker pool ***/
+
+/* A fixed set of worker threads, started on first use. editorPoolRun()
+   hands out task indices of one batch to the workers and to the calling
+   thread, and returns once every task has finished. editorPoolStart()
+   hands a batch to the workers alone and returns at once; editorPoolWait()
+   then helps finish it. There is one batch at a time: starting another
+   waits for the current one. */
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t idle;
+    pthread_t threads[POOL_MAX_THREADS];
+    int nThreads;
+    int started;
+    void (*fn)(int task, void *arg);
+    void *arg;
+    int tasks;
+    int next;
+    int done;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER
+};
+
+/* Runs tasks of the current batch until none are left. Called with the
+   lock held; drops it around each task. */
+static void poolDrain(){
+    while(pool.next < pool.tasks){
+        int task = pool.next++;
+        void (*fn)(int, void *) = pool.fn;
+        void *arg = pool.arg;
+        pthread_mutex_unlock(&pool.lock);
+        fn(task, arg);
+        pthread_mutex_lock(&pool.lock);
+        if(++pool.done == pool.tasks) pthread_cond_broadcast(&pool.idle);
+    }
+}
+
+static void *poolWorker(void *unused){
+    (void)unused;
+    pthread_mutex_lock(&pool.lock);
+    while(1){
+        while(pool.next >= pool.tasks) pthread_cond_wait(&pool.work, &pool.lock);
+        poolDrain();
+    }
+    return NULL;
+}
+
+int editorPoolThreads(){
+    if(!pool.started){
+        pool.started = 1;
+        /* At least one worker, so background batches make progress. */
+        long n = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+        if(n < 1) n = 1;
+        if(n > POOL_MAX_THREADS) n = POOL_MAX_THREADS;
+        int i;
+        for(i = 0; i < n; ++i){
+            if(pthread_create(&pool.threads[i], NULL, poolWorker, NULL) != 0) break;
+            pthread_detach(pool.threads[i]);
+        }
+        pool.nThreads = i;
+    }
+    return pool.nThreads + 1;
+}
+
+void editorPoolStart(int tasks, void (*fn)(int task, void *arg), void *arg){
+    if(tasks <= 0) return;
+    editorPoolThreads();
+    pthread_mutex_lock(&pool.lock);
+    while(pool.done < pool.tasks) pthread_cond_wait(&pool.idle, &pool.lock);
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.tasks = tasks;
+    pool.next = 0;
+    pool.done = 0;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+void editorPoolWait(){
+    pthread_mutex_lock(&pool.lock);
+    poolDrain();
+    while(pool.done < pool.tasks) pthread_cond_wait(&pool.idle, &pool.lock);
+    pool.tasks = 0;
+    pool.next = 0;
+    pool.done = 0;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+void editorPoolRun(int tasks, void (*fn)(int task, void *arg), void *arg){
+    editorPoolStart(tasks, fn, arg);
+    editorPoolWait();
+}
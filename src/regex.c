@@ -0,0 +1,605 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** regular expressions ***/
+
+/* Patterns are parsed into a small syntax tree and compiled into a
+   Thompson NFA, either of the pattern or of the pattern reversed. A search
+   runs the reversed NFA as a lazily built DFA from the end of the row
+   towards its start, starting a new thread at every position; the last
+   accepting position it passes is the leftmost match start. The forward
+   NFA, run anchored from a start, gives the longest match's end. Every
+   byte costs one table lookup once the DFA is warm and at most one
+   NFA-set step when it is not, so matching is linear in the row length
+   whatever the pattern. The DFA cache is bounded: when it fills up it is
+   flushed and rebuilt from the current state.
+
+   Syntax: literals, '.', [...] classes with ranges and '^' negation,
+   \d \w \s \D \W \S, escapes of metacharacters, grouping with (), and the
+   operators |, *, + and ?, plus the ^ and $ anchors. */
+
+enum { AST_CLASS, AST_CAT, AST_ALT, AST_STAR, AST_PLUS, AST_QUEST, AST_BOL, AST_EOL, AST_EMPTY };
+enum { RE_CLASS, RE_SPLIT, RE_MATCH, RE_BEGIN, RE_END };
+
+typedef struct astNode {
+    int op;
+    int a;
+    int b;
+} astNode;
+
+struct reParser {
+    const char *p;
+    regex *re;
+    astNode *ast;
+    int nAst;
+    int capAst;
+    int icase;
+    int reverse;
+    const char *error;
+};
+
+static int addClass(regex *re){
+    if(re -> nClasses == re -> capClasses){
+        re -> capClasses = re -> capClasses ? re -> capClasses * 2 : 16;
+        re -> classes = realloc(re -> classes, sizeof(*re -> classes) * re -> capClasses);
+        if(re -> classes == NULL) die("realloc");
+    }
+    memset(re -> classes[re -> nClasses], 0, sizeof(*re -> classes));
+    return re -> nClasses++;
+}
+
+static void classSet(struct reParser *ps, int cls, int c){
+    unsigned char *bits = ps -> re -> classes[cls];
+    bits[c >> 3] |= 1 << (c & 7);
+    if(ps -> icase && isalpha(c)){
+        int other = isupper(c) ? tolower(c) : toupper(c);
+        bits[other >> 3] |= 1 << (other & 7);
+    }
+}
+
+static int classHas(const regex *re, int cls, int c){
+    return (re -> classes[cls][c >> 3] >> (c & 7)) & 1;
+}
+
+static int addAst(struct reParser *ps, int op, int a, int b){
+    if(ps -> nAst == ps -> capAst){
+        ps -> capAst = ps -> capAst ? ps -> capAst * 2 : 32;
+        ps -> ast = realloc(ps -> ast, sizeof(astNode) * ps -> capAst);
+        if(ps -> ast == NULL) die("realloc");
+    }
+    ps -> ast[ps -> nAst].op = op;
+    ps -> ast[ps -> nAst].a = a;
+    ps -> ast[ps -> nAst].b = b;
+    return ps -> nAst++;
+}
+
+/* Adds the set named by a \d, \w or \s escape (or its negation). */
+static int classEscape(struct reParser *ps, int cls, int e){
+    int c;
+    int neg = isupper(e);
+    int want = tolower(e);
+    if(want != 'd' && want != 'w' && want != 's') return 0;
+    for(c = 0; c < 256; ++c){
+        int in = (want == 'd' && isdigit(c)) ||
+                 (want == 'w' && (isalnum(c) || c == '_')) ||
+                 (want == 's' && isspace(c));
+        if(in != neg) classSet(ps, cls, c);
+    }
+    return 1;
+}
+
+static int escapedChar(int e){
+    switch(e){
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        default: return e;
+    }
+}
+
+static int parseAlt(struct reParser *ps);
+
+static int parseBracket(struct reParser *ps){
+    int cls = addClass(ps -> re);
+    int neg = 0;
+    if(*ps -> p == '^'){
+        neg = 1;
+        ps -> p++;
+    }
+    int first = 1;
+    while(*ps -> p && (*ps -> p != ']' || first)){
+        int c = (unsigned char)*ps -> p++;
+        first = 0;
+        if(c == '\\'){
+            if(*ps -> p == '\0') break;
+            int e = (unsigned char)*ps -> p++;
+            if(classEscape(ps, cls, e)) continue;
+            c = escapedChar(e);
+        }
+        if(ps -> p[0] == '-' && ps -> p[1] && ps -> p[1] != ']'){
+            int hi = (unsigned char)ps -> p[1];
+            ps -> p += 2;
+            if(hi == '\\' && *ps -> p) hi = escapedChar((unsigned char)*ps -> p++);
+            if(hi < c){
+                ps -> error = "bad range";
+                return -1;
+            }
+            for(; c <= hi; ++c) classSet(ps, cls, c);
+        } else {
+            classSet(ps, cls, c);
+        }
+    }
+    if(*ps -> p != ']'){
+        ps -> error = "missing ]";
+        return -1;
+    }
+    ps -> p++;
+    if(neg){
+        int i;
+        for(i = 0; i < 32; ++i) ps -> re -> classes[cls][i] ^= 0xff;
+    }
+    return addAst(ps, AST_CLASS, cls, 0);
+}
+
+static int parseAtom(struct reParser *ps){
+    int c = (unsigned char)*ps -> p;
+    int cls;
+    switch(c){
+        case '(': {
+            ps -> p++;
+            int inner = parseAlt(ps);
+            if(inner < 0) return -1;
+            if(*ps -> p != ')'){
+                ps -> error = "missing )";
+                return -1;
+            }
+            ps -> p++;
+            return inner;
+        }
+        case '[':
+            ps -> p++;
+            return parseBracket(ps);
+        case '.':
+            ps -> p++;
+            cls = addClass(ps -> re);
+            memset(ps -> re -> classes[cls], 0xff, 32);
+            return addAst(ps, AST_CLASS, cls, 0);
+        case '^':
+            ps -> p++;
+            return addAst(ps, AST_BOL, 0, 0);
+        case '$':
+            ps -> p++;
+            return addAst(ps, AST_EOL, 0, 0);
+        case '*': case '+': case '?':
+            ps -> error = "nothing to repeat";
+            return -1;
+        case '\\':
+            ps -> p++;
+            if(*ps -> p == '\0'){
+                ps -> error = "trailing \\";
+                return -1;
+            }
+            c = (unsigned char)*ps -> p++;
+            cls = addClass(ps -> re);
+            if(!classEscape(ps, cls, c)) classSet(ps, cls, escapedChar(c));
+            return addAst(ps, AST_CLASS, cls, 0);
+        default:
+            ps -> p++;
+            cls = addClass(ps -> re);
+            classSet(ps, cls, c);
+            return addAst(ps, AST_CLASS, cls, 0);
+    }
+}
+
+static int parseRepeat(struct reParser *ps){
+    int node = parseAtom(ps);
+    while(node >= 0){
+        char c = *ps -> p;
+        if(c == '*') node = addAst(ps, AST_STAR, node, 0);
+        else if(c == '+') node = addAst(ps, AST_PLUS, node, 0);
+        else if(c == '?') node = addAst(ps, AST_QUEST, node, 0);
+        else break;
+        ps -> p++;
+    }
+    return node;
+}
+
+static int parseCat(struct reParser *ps){
+    int node = -1;
+    while(*ps -> p && *ps -> p != '|' && *ps -> p != ')'){
+        int next = parseRepeat(ps);
+        if(next < 0) return -1;
+        node = node < 0 ? next : addAst(ps, AST_CAT, node, next);
+    }
+    return node < 0 ? addAst(ps, AST_EMPTY, 0, 0) : node;
+}
+
+static int parseAlt(struct reParser *ps){
+    int node = parseCat(ps);
+    while(node >= 0 && *ps -> p == '|'){
+        ps -> p++;
+        int next = parseCat(ps);
+        if(next < 0) return -1;
+        node = addAst(ps, AST_ALT, node, next);
+    }
+    return node;
+}
+
+static int addNode(regex *re, int op, int out, int out1, int cls){
+    if(re -> nNodes == REGEX_MAX_NODES) return -1;
+    if(re -> nNodes == re -> capNodes){
+        re -> capNodes = re -> capNodes ? re -> capNodes * 2 : 64;
+        re -> nodes = realloc(re -> nodes, sizeof(reNode) * re -> capNodes);
+        if(re -> nodes == NULL) die("realloc");
+    }
+    reNode *n = &re -> nodes[re -> nNodes];
+    n -> op = op;
+    n -> out = out;
+    n -> out1 = out1;
+    n -> cls = cls;
+    return re -> nNodes++;
+}
+
+/* Compiles ast node i in front of 'next'. RE_BEGIN holds before anything
+   has been read and RE_END once the input is exhausted, so in a reversed
+   program '^' and '$' swap roles along with the order of concatenation. */
+static int compileNode(struct reParser *ps, int i, int next){
+    astNode *n = &ps -> ast[i];
+    regex *re = ps -> re;
+    int body, loop;
+    if(next < 0) return -1;
+    switch(n -> op){
+        case AST_CLASS: return addNode(re, RE_CLASS, next, -1, n -> a);
+        case AST_CAT:
+            if(ps -> reverse) return compileNode(ps, n -> b, compileNode(ps, n -> a, next));
+            return compileNode(ps, n -> a, compileNode(ps, n -> b, next));
+        case AST_ALT: {
+            int l = compileNode(ps, n -> a, next);
+            int r = compileNode(ps, n -> b, next);
+            if(l < 0 || r < 0) return -1;
+            return addNode(re, RE_SPLIT, l, r, 0);
+        }
+        case AST_STAR:
+        case AST_PLUS:
+            loop = addNode(re, RE_SPLIT, -1, next, 0);
+            if(loop < 0) return -1;
+            body = compileNode(ps, n -> a, loop);
+            if(body < 0) return -1;
+            re -> nodes[loop].out = body;
+            return n -> op == AST_STAR ? loop : body;
+        case AST_QUEST:
+            body = compileNode(ps, n -> a, next);
+            if(body < 0) return -1;
+            return addNode(re, RE_SPLIT, body, next, 0);
+        case AST_BOL: return addNode(re, ps -> reverse ? RE_END : RE_BEGIN, next, -1, 0);
+        case AST_EOL: return addNode(re, ps -> reverse ? RE_BEGIN : RE_END, next, -1, 0);
+        default: return next;
+    }
+}
+
+int editorRegexCompile(regex *re, const char *pattern, int icase, int reverse, const char **error){
+    memset(re, 0, sizeof(*re));
+    struct reParser ps = {pattern, re, NULL, 0, 0, icase, reverse, NULL};
+    int root = parseAlt(&ps);
+    if(root >= 0 && *ps.p != '\0') ps.error = "unmatched )";
+    if(root >= 0 && ps.error == NULL){
+        int match = addNode(re, RE_MATCH, -1, -1, 0);
+        re -> start = compileNode(&ps, root, match);
+        if(re -> start < 0) ps.error = "pattern too large";
+    }
+    free(ps.ast);
+    if(ps.error){
+        *error = ps.error;
+        editorRegexFree(re);
+        return -1;
+    }
+    return 0;
+}
+
+void editorRegexFree(regex *re){
+    free(re -> nodes);
+    free(re -> classes);
+    memset(re, 0, sizeof(*re));
+}
+
+/*** lazy DFA ***/
+
+/* State s's transitions live in trans[s * 256 .. s * 256 + 255] (-1 until
+   built) and its sorted NFA node set in setPool. Both are bounded: when
+   either fills up the whole cache is dropped and rebuilt on demand. */
+
+#define CL_BEGIN 1
+#define CL_END 2
+#define DFA_TABLE (REGEX_MAX_STATES * 4)
+#define DFA_POOL (REGEX_MAX_STATES * 64)
+
+struct dfaState {
+    int off;
+    int n;
+    unsigned hash;
+    signed char acceptEnd;
+};
+
+/* Adds the epsilon closure of 'node' to d -> set. Assertions are followed
+   only when 'flags' says they hold here; an END assertion that does not
+   hold yet stays in the set so it can be resolved at the row start. */
+static void closureAdd(regexDfa *d, int node, int *n, int flags){
+    const reNode *nodes = d -> re -> nodes;
+    int sp = 0;
+    d -> stack[sp++] = node;
+    while(sp > 0){
+        int i = d -> stack[--sp];
+        if(i < 0 || d -> mark[i] == d -> gen) continue;
+        d -> mark[i] = d -> gen;
+        const reNode *x = &nodes[i];
+        switch(x -> op){
+            case RE_SPLIT:
+                d -> stack[sp++] = x -> out1;
+                d -> stack[sp++] = x -> out;
+                break;
+            case RE_BEGIN:
+                if(flags & CL_BEGIN) d -> stack[sp++] = x -> out;
+                break;
+            case RE_END:
+                if(flags & CL_END){
+                    d -> stack[sp++] = x -> out;
+                    break;
+                }
+                d -> set[(*n)++] = i;
+                break;
+            default:
+                d -> set[(*n)++] = i;
+                break;
+        }
+    }
+}
+
+static int cmpInt(const void *a, const void *b){
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static void dfaFlush(regexDfa *d){
+    int i;
+    for(i = 0; i < DFA_TABLE; ++i) d -> table[i] = -1;
+    d -> nStates = 0;
+    d -> poolUsed = 0;
+    d -> begin[0] = -1;
+    d -> begin[1] = -1;
+    d -> flushes++;
+}
+
+/* Returns the state for the n NFA nodes in d -> set, creating it (and
+   flushing a full cache first) when it does not exist yet. */
+static int dfaIntern(regexDfa *d, int n){
+    qsort(d -> set, n, sizeof(int), cmpInt);
+    unsigned h = 2166136261u;
+    int i;
+    for(i = 0; i < n; ++i) h = (h ^ (unsigned)d -> set[i]) * 16777619u;
+
+    unsigned slot = h & (DFA_TABLE - 1);
+    while(d -> table[slot] >= 0){
+        dfaState *st = &d -> states[d -> table[slot]];
+        if(st -> hash == h && st -> n == n &&
+           memcmp(d -> setPool + st -> off, d -> set, sizeof(int) * n) == 0){
+            return d -> table[slot];
+        }
+        slot = (slot + 1) & (DFA_TABLE - 1);
+    }
+
+    if(d -> nStates == REGEX_MAX_STATES || d -> poolUsed + n > d -> poolCap){
+        dfaFlush(d);
+        slot = h & (DFA_TABLE - 1);
+    }
+    if(n > d -> poolCap) die("regex state too large");
+    int s = d -> nStates++;
+    dfaState *st = &d -> states[s];
+    st -> off = d -> poolUsed;
+    st -> n = n;
+    st -> hash = h;
+    st -> acceptEnd = -1;
+    memcpy(d -> setPool + st -> off, d -> set, sizeof(int) * n);
+    d -> poolUsed += n;
+
+    d -> accept[s] = 0;
+    for(i = 0; i < n; ++i){
+        if(d -> re -> nodes[d -> set[i]].op == RE_MATCH) d -> accept[s] = 1;
+    }
+    int *next = &d -> trans[s * 256];
+    for(i = 0; i < 256; ++i) next[i] = -1;
+    d -> table[slot] = s;
+    return s;
+}
+
+/* The state before anything is read. RE_BEGIN holds only when reading
+   starts at the edge of the row. */
+static int dfaBegin(regexDfa *d, int edge){
+    if(d -> begin[edge] < 0){
+        int n = 0;
+        d -> gen++;
+        closureAdd(d, d -> re -> start, &n, edge ? CL_BEGIN : 0);
+        d -> begin[edge] = dfaIntern(d, n);
+    }
+    return d -> begin[edge];
+}
+
+/* Builds the transition of state s on byte c. An unanchored DFA starts a
+   new thread at every position. */
+static int dfaStep(regexDfa *d, int s, int c){
+    const int *set = d -> setPool + d -> states[s].off;
+    int count = d -> states[s].n;
+    int n = 0;
+    int i;
+    d -> gen++;
+    for(i = 0; i < count; ++i){
+        const reNode *x = &d -> re -> nodes[set[i]];
+        if(x -> op == RE_CLASS && classHas(d -> re, x -> cls, c)) closureAdd(d, x -> out, &n, 0);
+    }
+    if(!d -> anchored) closureAdd(d, d -> re -> start, &n, 0);
+    int flushes = d -> flushes;
+    int t = dfaIntern(d, n);
+    if(d -> flushes == flushes) d -> trans[s * 256 + c] = t;
+    return t;
+}
+
+/* Whether state s accepts once RE_END holds, i.e. at the far edge of the row. */
+static int dfaAcceptEnd(regexDfa *d, int s){
+    dfaState *st = &d -> states[s];
+    if(st -> acceptEnd < 0){
+        const int *set = d -> setPool + st -> off;
+        int n = 0;
+        int i;
+        d -> gen++;
+        for(i = 0; i < st -> n; ++i){
+            if(d -> re -> nodes[set[i]].op == RE_END) closureAdd(d, d -> re -> nodes[set[i]].out, &n, CL_END);
+        }
+        st -> acceptEnd = d -> accept[s];
+        for(i = 0; i < n; ++i){
+            if(d -> re -> nodes[d -> set[i]].op == RE_MATCH) st -> acceptEnd = 1;
+        }
+    }
+    return st -> acceptEnd;
+}
+
+void editorDfaInit(regexDfa *d, const regex *re, int anchored){
+    d -> re = re;
+    d -> anchored = anchored;
+    d -> poolCap = DFA_POOL > re -> nNodes ? DFA_POOL : re -> nNodes;
+    d -> states = malloc(sizeof(dfaState) * REGEX_MAX_STATES);
+    d -> accept = malloc(REGEX_MAX_STATES);
+    d -> trans = malloc(sizeof(int) * 256 * REGEX_MAX_STATES);
+    d -> table = malloc(sizeof(int) * DFA_TABLE);
+    d -> setPool = malloc(sizeof(int) * d -> poolCap);
+    d -> mark = calloc(re -> nNodes, sizeof(int));
+    d -> set = malloc(sizeof(int) * re -> nNodes);
+    d -> stack = malloc(sizeof(int) * (2 * re -> nNodes + 2));
+    if(d -> states == NULL || d -> accept == NULL || d -> trans == NULL ||
+       d -> table == NULL || d -> setPool == NULL || d -> mark == NULL ||
+       d -> set == NULL || d -> stack == NULL) die("malloc");
+    d -> gen = 0;
+    dfaFlush(d);
+    d -> flushes = 0;
+}
+
+void editorDfaFree(regexDfa *d){
+    free(d -> states);
+    free(d -> accept);
+    free(d -> trans);
+    free(d -> table);
+    free(d -> setPool);
+    free(d -> mark);
+    free(d -> set);
+    free(d -> stack);
+}
+
+/* Feeds buf[lo, hi) to the DFA backwards from state s, recording in *best
+   the lowest accepting position (offset by base). */
+static int dfaScan(regexDfa *d, int s, const char *buf, int lo, int hi, int base, int *best){
+    const int *trans = d -> trans;
+    const char *accept = d -> accept;
+    int i;
+    for(i = hi - 1; i >= lo; --i){
+        int c = (unsigned char)buf[i];
+        int t = trans[s * 256 + c];
+        if(t < 0){
+            t = dfaStep(d, s, c);
+            trans = d -> trans;
+        }
+        s = t;
+        if(accept[s]) *best = base + i;
+    }
+    return s;
+}
+
+/* Like dfaScan, but flags every accepting position in hits. */
+static int dfaScanMark(regexDfa *d, int s, const char *buf, int hi, char *hits){
+    int i;
+    for(i = hi - 1; i >= 0; --i){
+        int c = (unsigned char)buf[i];
+        int t = d -> trans[s * 256 + c];
+        s = t >= 0 ? t : dfaStep(d, s, c);
+        hits[i] = d -> accept[s];
+    }
+    return s;
+}
+
+/* Flags in hits[0..size] every column of a row at which a match starts.
+   Returns the number of such columns. */
+int editorRegexStarts(regexDfa *d, erow *row, char *hits){
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    int len = aLen + bLen;
+
+    int s = dfaBegin(d, 1);
+    hits[len] = d -> accept[s];
+    s = dfaScanMark(d, s, b, bLen, hits + aLen);
+    s = dfaScanMark(d, s, a, aLen, hits);
+    if(dfaAcceptEnd(d, s)) hits[0] = 1;
+    int count = 0;
+    int i;
+    for(i = 0; i <= len; ++i) count += hits[i];
+    return count;
+}
+
+/* Leftmost match starting at or after column 'from' of a row, read across
+   the gap, or -1. */
+int editorRegexSearchRow(regexDfa *d, erow *row, int from){
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    int len = aLen + bLen;
+    if(from > len) return -1;
+
+    int s = dfaBegin(d, 1);
+    int best = d -> accept[s] ? len : -1;
+    s = dfaScan(d, s, b, from > aLen ? from - aLen : 0, bLen, aLen, &best);
+    if(from < aLen) s = dfaScan(d, s, a, from, aLen, 0, &best);
+    if(from == 0 && best != 0 && dfaAcceptEnd(d, s)) best = 0;
+    return best;
+}
+
+/* Finds the first match in rows [at, end), starting at column 'from' of
+   row 'at'. Returns the row index and sets *col, or returns -1. */
+int editorRegexSearchForward(regexDfa *d, int at, int from, int end, int *col){
+    while(at < end){
+        int runLen;
+        erow *run = editorRowRun(at, &runLen);
+        if(runLen > end - at) runLen = end - at;
+        int k;
+        for(k = 0; k < runLen; ++k){
+            int c = editorRegexSearchRow(d, &run[k], from);
+            if(c >= 0){
+                *col = c;
+                return at + k;
+            }
+            from = 0;
+        }
+        at += runLen;
+    }
+    return -1;
+}
+
+/* End of the longest match that starts exactly at column 'from', using a
+   DFA over the forward program in anchored mode, or -1. */
+int editorRegexMatchEnd(regexDfa *d, erow *row, int from){
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    int len = aLen + bLen;
+    if(from > len) return -1;
+
+    int s = dfaBegin(d, from == 0);
+    int best = d -> accept[s] ? from : -1;
+    int i;
+    for(i = from; i < len && d -> states[s].n > 0; ++i){
+        int c = (unsigned char)(i < aLen ? a[i] : b[i - aLen]);
+        int t = d -> trans[s * 256 + c];
+        s = t >= 0 ? t : dfaStep(d, s, c);
+        if(d -> accept[s]) best = i + 1;
+    }
+    if(i == len && best != len && dfaAcceptEnd(d, s)) best = len;
+    return best;
+}
@@ -0,0 +1,246 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** replace all ***/
+
+/* Replace-all rewrites every row with a match of a literal query as one
+   batch. The buffer is cut into REPLACE_TASK_ROWS-row tasks that run on
+   the worker pool. Each task scans its rows with its own copy of the
+   pattern and writes the new text of every row with a match into a buffer
+   of its own, in one pass over the row. The input thread then swaps those
+   rows in, in order: a row takes its new text in one copy, so it is
+   rendered once and bumps E.dirty once however many matches it had.
+   Matches do not overlap; scanning goes on after the end of each one.
+
+   The batch is a single undo record holding the columns of the matches,
+   and each match is one journal record. Workers only read rows, and the
+   buffer is not edited until all of them are done. */
+
+/* A row with matches, as found by a task. */
+struct replaceRow {
+    int at;
+    /* Its new text in the task's text buffer. */
+    size_t off;
+    int len;
+    /* Its matches in the task's cols. */
+    int first, n;
+};
+
+struct replaceTask {
+    char *text;
+    size_t len, cap;
+    struct replaceRow *rows;
+    int nRows, capRows;
+    int *cols;
+    int nCols, capCols;
+};
+
+struct replaceJob {
+    const char *query, *with;
+    int queryLen, withLen;
+    struct replaceTask *tasks;
+};
+
+/* Copies bytes [from, to) of a row split into spans a and b to out and
+   returns the end of the copy. */
+static char *copySpan(char *out, const char *a, int aLen, const char *b, int from, int to){
+    if(from < aLen){
+        int n = (to < aLen ? to : aLen) - from;
+        memcpy(out, a + from, n);
+        out += n;
+        from = aLen;
+    }
+    if(to > from){
+        memcpy(out, b + from - aLen, to - from);
+        out += to - from;
+    }
+    return out;
+}
+
+/* Writes the text of a row with the fromLen bytes at each of the n
+   columns cols replaced by 'to' to dst, which must have room for it, and
+   returns its length. */
+static int replaceBuild(erow *row, const int *cols, int n, int fromLen, const char *to, int toLen, char *dst){
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    char *out = dst;
+    int at = 0;
+    int k;
+    for(k = 0; k < n; ++k){
+        out = copySpan(out, a, aLen, b, at, cols[k]);
+        memcpy(out, to, toLen);
+        out += toLen;
+        at = cols[k] + fromLen;
+    }
+    out = copySpan(out, a, aLen, b, at, row -> size);
+    return out - dst;
+}
+
+static void taskPushCol(struct replaceTask *t, int col){
+    if(t -> nCols == t -> capCols){
+        t -> capCols = t -> capCols ? t -> capCols * 2 : 256;
+        t -> cols = realloc(t -> cols, t -> capCols * sizeof(*t -> cols));
+        if(t -> cols == NULL) die("realloc");
+    }
+    t -> cols[t -> nCols++] = col;
+}
+
+/* Adds a row with the matches from 'first' on to a task and returns where
+   its new text of 'len' bytes goes. */
+static char *taskPushRow(struct replaceTask *t, int at, int first, size_t len){
+    if(t -> nRows == t -> capRows){
+        t -> capRows = t -> capRows ? t -> capRows * 2 : 64;
+        t -> rows = realloc(t -> rows, t -> capRows * sizeof(*t -> rows));
+        if(t -> rows == NULL) die("realloc");
+    }
+    if(t -> cap - t -> len <= len){
+        t -> cap = t -> cap * 2 > t -> len + len ? t -> cap * 2 : t -> len + len + 1;
+        t -> text = realloc(t -> text, t -> cap);
+        if(t -> text == NULL) die("realloc");
+    }
+    struct replaceRow *r = &t -> rows[t -> nRows++];
+    r -> at = at;
+    r -> off = t -> len;
+    r -> len = len;
+    r -> first = first;
+    r -> n = t -> nCols - first;
+    t -> len += len;
+    return t -> text + r -> off;
+}
+
+static void replaceTaskRun(int task, void *arg){
+    struct replaceJob *job = arg;
+    struct replaceTask *t = &job -> tasks[task];
+    searchPattern p;
+    editorPatternInit(&p, job -> query, 0);
+    int k = task * REPLACE_TASK_ROWS;
+    int end = k + REPLACE_TASK_ROWS < E.numRows ? k + REPLACE_TASK_ROWS : E.numRows;
+    while(k < end){
+        int len;
+        erow *run = editorRowRun(k, &len);
+        int i;
+        for(i = 0; i < len && k < end; ++i, ++k){
+            erow *row = &run[i];
+            int first = t -> nCols;
+            int col = 0;
+            while((col = editorSearchRow(&p, row, col)) >= 0){
+                taskPushCol(t, col);
+                col += job -> queryLen;
+            }
+            int n = t -> nCols - first;
+            if(n == 0) continue;
+            size_t size = row -> size + (size_t)n * (job -> withLen - job -> queryLen);
+            char *dst = taskPushRow(t, k, first, size);
+            replaceBuild(row, t -> cols + first, n, job -> queryLen, job -> with, job -> withLen, dst);
+        }
+    }
+    editorPatternFree(&p);
+}
+
+/* Gives row 'at' its new text and journals its n matches, where cols are
+   their columns in the old text and fromLen bytes each became 'to'. */
+static void replaceSwap(int at, const char *s, int len, const int *cols, int n, int fromLen, const char *to, int toLen){
+    editorRowSetText(editorRowAt(at), s, len);
+    int k;
+    for(k = 0; k < n; ++k) editorJournalReplace(at, cols[k] + k * (toLen - fromLen), fromLen, to, toLen);
+    editorSyntaxTouch(at);
+}
+
+static void replaceClampCursor(){
+    if(E.cy >= E.numRows) return;
+    erow *row = editorRowAt(E.cy);
+    if(E.cx > row -> size) E.cx = row -> size;
+    E.cx = editorRowSnapCx(row, E.cx);
+}
+
+/* Replaces every occurrence of a query, prompted for along with its
+   replacement, in the whole buffer. */
+void editorReplaceAll(){
+    char *query = editorPrompt("Replace: %s (ESC to cancel)", NULL);
+    if(query == NULL) return;
+    char *with = editorPrompt("Replace with: %s (ESC to cancel)", NULL);
+    if(with == NULL){
+        free(query);
+        return;
+    }
+    TRACE_BEGIN(editorReplaceAll);
+    struct replaceJob job = {query, with, strlen(query), strlen(with), NULL};
+    int nTasks = (E.numRows + REPLACE_TASK_ROWS - 1) / REPLACE_TASK_ROWS;
+    job.tasks = calloc(nTasks ? nTasks : 1, sizeof(*job.tasks));
+    if(job.tasks == NULL) die("calloc");
+    editorPoolRun(nTasks, replaceTaskRun, &job);
+
+    int rows = 0, matches = 0;
+    int i, k;
+    for(i = 0; i < nTasks; ++i){
+        struct replaceTask *t = &job.tasks[i];
+        for(k = 0; k < t -> nRows; ++k){
+            struct replaceRow *r = &t -> rows[k];
+            if(rows++ == 0) editorUndoReplace(query, with);
+            editorUndoReplaceRow(r -> at, t -> cols + r -> first, r -> n);
+            replaceSwap(r -> at, t -> text + r -> off, r -> len, t -> cols + r -> first, r -> n,
+                        job.queryLen, with, job.withLen);
+            matches += r -> n;
+        }
+        free(t -> text);
+        free(t -> rows);
+        free(t -> cols);
+    }
+    free(job.tasks);
+    replaceClampCursor();
+    TRACE_END(editorReplaceAll);
+    if(matches) editorSetStatusMessage("Replaced %d occurrences on %d lines", matches, rows);
+    else editorSetStatusMessage("Not found: %s", query);
+    free(query);
+    free(with);
+}
+
+/* Redoes, or with reverse set undoes, a replace-all from its undo record
+   text (see editorUndoReplace()). */
+void editorReplaceReplay(const char *text, size_t len, int reverse){
+    int lens[2];
+    memcpy(lens, text, sizeof(lens));
+    const char *query = text + sizeof(lens);
+    const char *with = query + lens[0];
+    const char *to = reverse ? query : with;
+    int fromLen = reverse ? lens[1] : lens[0];
+    int toLen = reverse ? lens[0] : lens[1];
+    size_t at = sizeof(lens) + lens[0] + lens[1];
+    int *cols = NULL;
+    int capCols = 0;
+    char *buf = NULL;
+    size_t capBuf = 0;
+    while(at < len){
+        int head[2];
+        memcpy(head, text + at, sizeof(head));
+        at += sizeof(head);
+        int row = head[0], n = head[1];
+        if(n > capCols){
+            capCols = n;
+            cols = realloc(cols, capCols * sizeof(*cols));
+            if(cols == NULL) die("realloc");
+        }
+        memcpy(cols, text + at, n * sizeof(*cols));
+        at += n * sizeof(*cols);
+        /* Undoing, the replacements sit where the earlier ones in the row
+           moved them. */
+        int k;
+        if(reverse){
+            for(k = 0; k < n; ++k) cols[k] += k * (lens[1] - lens[0]);
+        }
+        erow *r = editorRowAt(row);
+        size_t size = r -> size + (size_t)n * (toLen - fromLen);
+        if(size >= capBuf){
+            capBuf = size + 1;
+            buf = realloc(buf, capBuf);
+            if(buf == NULL) die("realloc");
+        }
+        int newLen = replaceBuild(r, cols, n, fromLen, to, toLen, buf);
+        replaceSwap(row, buf, newLen, cols, n, fromLen, to, toLen);
+    }
+    free(cols);
+    free(buf);
+    replaceClampCursor();
+}
@@ -2,12 +2,213 @@
 #include "../include/data.h"
 #include "../include/prototypes.h"
 
+/*** gap buffer ***/
 
-int editorRowCxToRx(erow *row, int cx){
+/* Row text lives in a gap buffer: chars[0, gap) holds the text before the
+   gap and the last (size - gap) bytes of the cap-sized allocation hold the
+   text after it. Edits move the gap to the cursor, so runs of typing or
+   deleting in one place cost O(1) amortized; buffers come from the
+   size-classed row allocator (row_mem.c). Short ASCII rows without tabs
+   skip the allocation and keep their text inline (ROW_INLINE), contiguous,
+   and edits just shift it; a row that outgrows the space, or gets a tab
+   or a non-ASCII byte, moves to a gap buffer. */
+
+#define GAP_LEN(row) ((row) -> text.ext.cap - (row) -> size)
+
+static int fitsInline(const char *s, size_t len){
+    return len <= ROW_INLINE_BYTES && memchr(s, '\t', len) == NULL && editorUtf8Ascii(s, len);
+}
+
+void editorRowSpans(erow *row, char **a, int *aLen, char **b, int *bLen){
+    if(row -> flags & ROW_INLINE){
+        *a = row -> text.inl;
+        *aLen = row -> size;
+        *b = row -> text.inl + row -> size;
+        *bLen = 0;
+        return;
+    }
+    *a = row -> text.ext.chars;
+    *aLen = row -> text.ext.gap;
+    *b = row -> text.ext.chars + row -> text.ext.gap + GAP_LEN(row);
+    *bLen = row -> size - row -> text.ext.gap;
+}
+
+static void editorRowSetExt(erow *row, char *s, int cap){
+    row -> text.ext.chars = s;
+    row -> text.ext.view.render = NULL;
+    row -> text.ext.gap = row -> size;
+    row -> text.ext.cap = cap;
+    row -> text.ext.rCap = 0;
+}
+
+/* Rows loaded from a file point straight into the mapping, or into the
+   loaded text arenas. They get a copy of their own the first time they
+   are modified. */
+static void editorRowOwn(erow *row){
+    if(!(row -> flags & ROW_MAPPED)) return;
+    char *s = row -> text.ext.chars;
+    if(fitsInline(s, row -> size)){
+        /* Without tabs and contiguous, it never had a render buffer, but
+           it may have been indexed before it was cut short. */
+        if(row -> viewFlags & ROW_INDEXED) editorRowIndexFree(row);
+        row -> viewFlags = 0;
+        memcpy(row -> text.inl, s, row -> size);
+        row -> flags = ROW_INLINE;
+        return;
+    }
+    int cap;
+    char *copy = editorRowMemAlloc(row -> size, &cap);
+    memcpy(copy, s, row -> size);
+    row -> text.ext.chars = copy;
+    row -> text.ext.cap = cap;
+    row -> text.ext.gap = row -> size;
+    row -> flags &= ~ROW_MAPPED;
+    editorRowIndexTouch(row, 0, cap);
+}
+
+/* Moves an inline row into a gap buffer with room for 'extra' more bytes. */
+static void editorRowSpill(erow *row, int extra){
+    int cap;
+    char *chars = editorRowMemAlloc(row -> size + extra, &cap);
+    memcpy(chars, row -> text.inl, row -> size);
+    row -> flags &= ~ROW_INLINE;
+    editorRowSetExt(row, chars, cap);
+}
+
+void editorRowAttach(erow *row, char *s){
+    /* Inline text costs nothing to keep. */
+    if(row -> flags & ROW_INLINE) return;
+    if(!(row -> flags & ROW_MAPPED)) editorRowMemFree(row -> text.ext.chars, row -> text.ext.cap);
+    row -> text.ext.chars = s;
+    row -> text.ext.cap = row -> size;
+    row -> text.ext.gap = row -> size;
+    row -> flags |= ROW_MAPPED;
+    editorRowIndexTouch(row, 0, row -> size);
+}
+
+static void editorRowMoveGap(erow *row, int at){
+    if(at == row -> text.ext.gap) return;
+    /* A row drawn straight from its text is about to be split by the gap. */
+    if(!(row -> viewFlags & ROW_INDEXED) && row -> text.ext.view.render == NULL) editorRowInvalidate(row, 0);
+    char *chars = row -> text.ext.chars;
+    int gap = row -> text.ext.gap;
+    int gapLen = GAP_LEN(row);
+    if(at < gap){
+        memmove(&chars[at + gapLen], &chars[at], gap - at);
+        editorRowIndexTouch(row, at, gap + gapLen);
+    }
+    else{
+        memmove(&chars[gap], &chars[gap + gapLen], at - gap);
+        editorRowIndexTouch(row, gap, at + gapLen);
+    }
+    row -> text.ext.gap = at;
+}
+
+/* Makes room for at least 'extra' bytes in the gap, growing geometrically. */
+static void editorRowReserve(erow *row, int extra){
+    if(GAP_LEN(row) >= extra) return;
+    char *old = row -> text.ext.chars;
+    int cap = row -> text.ext.cap;
+    int want = row -> size + extra;
+    if(want < cap * 2) want = cap * 2;
+    int newCap;
+    char *new = editorRowMemAlloc(want, &newCap);
+    int gap = row -> text.ext.gap;
+    int tail = row -> size - gap;
+    memcpy(new, old, gap);
+    memcpy(&new[newCap - tail], &old[cap - tail], tail);
+    editorRowMemFree(old, cap);
+    row -> text.ext.chars = new;
+    row -> text.ext.cap = newCap;
+    editorRowIndexTouch(row, 0, newCap);
+}
+
+/* Gets a row ready to take the 'len' bytes of s. Returns 1 if they still
+   fit inline, otherwise the row is left as a gap buffer with room. */
+static int editorRowPrepare(erow *row, const char *s, int len){
+    editorRowOwn(row);
+    if(row -> flags & ROW_INLINE){
+        if(row -> size + len <= ROW_INLINE_BYTES && fitsInline(s, len)) return 1;
+        editorRowSpill(row, len);
+    }
+    editorRowReserve(row, len);
+    return 0;
+}
+
+int editorRowCharAt(erow *row, int at){
+    if(row -> flags & ROW_INLINE) return (unsigned char)row -> text.inl[at];
+    if(at >= row -> text.ext.gap) at += GAP_LEN(row);
+    return (unsigned char)row -> text.ext.chars[at];
+}
+
+int editorRowTail(erow *row, int at, char **tail){
+    if(row -> flags & ROW_INLINE){
+        *tail = row -> text.inl + at;
+    }
+    else if(row -> text.ext.gap == row -> size){
+        *tail = row -> text.ext.chars + at;
+    }
+    else{
+        editorRowMoveGap(row, at);
+        *tail = row -> text.ext.chars + at + GAP_LEN(row);
+    }
+    return row -> size - at;
+}
+
+void editorRowTruncate(erow *row, int at){
+    if(at < 0 || at >= row -> size) return;
+    if(row -> flags & ROW_MAPPED){
+        row -> text.ext.cap = at;
+        row -> text.ext.gap = at;
+    }
+    else if(!(row -> flags & ROW_INLINE)){
+        editorRowMoveGap(row, at);
+        editorRowIndexTouch(row, at, row -> text.ext.cap);
+    }
+    row -> size = at;
+    editorRowInvalidate(row, at);
+    E.dirty++;
+}
+
+/*** row operations ***/
+
+/* Whether a row needs the column index (row_index.c): it is long, or has
+   non-ASCII text whose columns are not its bytes. An indexed row gives up
+   its render buffer. A row switches back once it is ASCII again and below
+   half of ROW_LONG_BYTES, so editing around the limit does not flip it on
+   every key. Only the text from 'from' on can have turned non-ASCII. */
+static int editorRowIndexed(erow *row, int from, char *a, int aLen, char *b, int bLen){
+    if(row -> flags & ROW_INLINE) return 0;
+    if(row -> viewFlags & ROW_INDEXED){
+        if(row -> size >= ROW_LONG_BYTES / 2 || !editorUtf8Ascii(a, aLen) || !editorUtf8Ascii(b, bLen))
+            return 1;
+        editorRowIndexFree(row);
+        row -> viewFlags &= ~ROW_INDEXED;
+        row -> text.ext.rCap = 0;
+        return 0;
+    }
+    int aFrom = from < aLen ? from : aLen;
+    int bFrom = from > aLen ? from - aLen : 0;
+    if(row -> size < ROW_LONG_BYTES && editorUtf8Ascii(a + aFrom, aLen - aFrom) &&
+       editorUtf8Ascii(b + bFrom, bLen - bFrom)) return 0;
+    editorRowMemFree(row -> text.ext.view.render, row -> text.ext.rCap);
+    row -> text.ext.view.index = NULL;
+    row -> text.ext.rCap = 0;
+    row -> viewFlags |= ROW_INDEXED;
+    return 1;
+}
+
+/* Render column of byte cx in a row that is not indexed, where every
+   byte but a tab takes one column. */
+static int editorRowPlainRx(erow *row, int cx){
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
     int rx = 0;
     int j;
     for(j = 0; j < cx; ++j){
-        if(row -> chars[j] == '\t'){
+        char c = j < aLen ? a[j] : b[j - aLen];
+        if(c == '\t'){
             rx += (TAB_STOP - 1) - (rx % TAB_STOP);
         }
         rx++;
@@ -15,94 +216,310 @@ int editorRowCxToRx(erow *row, int cx){
     return rx;
 }
 
+int editorRowCxToRx(erow *row, int cx){
+    editorUpdateRow(row);
+    if(row -> viewFlags & ROW_INDEXED) return editorRowIndexCxToRx(row, cx);
+    /* Every byte takes a column at least, so if the row is as wide as it
+       is long, each takes exactly one. */
+    if(row -> rSize == row -> size) return cx;
+    return editorRowPlainRx(row, cx);
+}
+
+/* Decodes the code point at byte 'at' of a row; returns its length. */
+int editorRowDecode(erow *row, int at, int *cp){
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    if(at >= aLen) return editorUtf8Decode(b + at - aLen, row -> size - at, cp);
+    if(at + 4 <= aLen || bLen == 0) return editorUtf8Decode(a + at, aLen - at, cp);
+    /* It may run across the gap. */
+    char seq[4];
+    int n;
+    for(n = 0; n < 4 && at + n < row -> size; ++n) seq[n] = editorRowCharAt(row, at + n);
+    return editorUtf8Decode(seq, n, cp);
+}
+
+/* Start of the code point that byte 'at' of a row belongs to. */
+int editorRowCharStart(erow *row, int at){
+    int j = at;
+    while(j > 0 && j > at - 3 && (editorRowCharAt(row, j) & 0xC0) == 0x80) j--;
+    int cp;
+    return j + editorRowDecode(row, j, &cp) > at ? j : at;
+}
+
+/* The cursor moves over a character and the zero-width marks that
+   follow it as one. These return where the one after, or before, byte
+   'at' starts. */
+int editorRowNextCx(erow *row, int at){
+    if(at >= row -> size) return row -> size;
+    int cp;
+    at += editorRowDecode(row, at, &cp);
+    while(at < row -> size && editorRowCharAt(row, at) >= 0x80){
+        int n = editorRowDecode(row, at, &cp);
+        if(editorUtf8Width(cp) != 0) break;
+        at += n;
+    }
+    return at;
+}
+
+int editorRowPrevCx(erow *row, int at){
+    while(at > 0){
+        int cp;
+        at = editorRowCharStart(row, at - 1);
+        editorRowDecode(row, at, &cp);
+        if(cp < 0x80 || editorUtf8Width(cp) != 0) break;
+    }
+    return at;
+}
+
+/* Moves 'at' back to the start of the character it is in. */
+int editorRowSnapCx(erow *row, int at){
+    if(at <= 0 || at >= row -> size) return at;
+    int prev = editorRowPrevCx(row, at);
+    return editorRowNextCx(row, prev) > at ? prev : at;
+}
 
+void editorRowInvalidate(erow *row, int at){
+    if(row -> staleFrom < 0 || at < row -> staleFrom) row -> staleFrom = at;
+}
+
+/* Brings render up to date. A row without tabs whose text is contiguous
+   is drawn straight from its text and keeps no render buffer; otherwise
+   only the part from the first edited column onwards is re-expanded, the
+   prefix before it is still valid. Indexed rows just update their index. */
 void editorUpdateRow(erow *row){
-    int tabs = 0;
-    int j = 0;
-    for(j = 0; j < row -> size; ++j){
-        if(row -> chars[j] == '\t') tabs++;
-    }
-    free(row -> render);
-    row -> render = malloc(row -> size + tabs * (TAB_STOP - 1) + 1);
-    int idx = 0;
-    for(j = 0; j < row -> size; ++j){
-        if(row -> chars[j] == '\t'){
-            row -> render[idx++] = ' ';
-            while(idx % TAB_STOP != 0) row -> render[idx++] = ' ';
+    if(row -> staleFrom < 0) return;
+    TRACE_BEGIN(editorUpdateRow);
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    if(editorRowIndexed(row, row -> staleFrom, a, aLen, b, bLen)){
+        row -> rSize = editorRowIndexWidth(row);
+    }
+    else if((aLen == 0 || bLen == 0) && memchr(a, '\t', aLen) == NULL && memchr(b, '\t', bLen) == NULL){
+        if(!(row -> flags & ROW_INLINE)){
+            editorRowMemFree(row -> text.ext.view.render, row -> text.ext.rCap);
+            row -> text.ext.view.render = NULL;
+            row -> text.ext.rCap = 0;
         }
-        else{
-            row -> render[idx++] = row -> chars[j];
+        row -> rSize = row -> size;
+    }
+    else{
+        int from = row -> text.ext.view.render ? row -> staleFrom : 0;
+        if(from > row -> size) from = row -> size;
+        int tabs = 0;
+        int j;
+        for(j = from; j < row -> size; ++j){
+            if((j < aLen ? a[j] : b[j - aLen]) == '\t') tabs++;
+        }
+        int idx = from ? editorRowPlainRx(row, from) : 0;
+        int need = idx + (row -> size - from) + tabs * (TAB_STOP - 1);
+        char *render = row -> text.ext.view.render;
+        if(need > row -> text.ext.rCap){
+            int cap;
+            render = editorRowMemAlloc(need, &cap);
+            if(idx) memcpy(render, row -> text.ext.view.render, idx);
+            editorRowMemFree(row -> text.ext.view.render, row -> text.ext.rCap);
+            row -> text.ext.view.render = render;
+            row -> text.ext.rCap = cap;
         }
+        for(j = from; j < row -> size; ++j){
+            char c = j < aLen ? a[j] : b[j - aLen];
+            if(c == '\t'){
+                render[idx++] = ' ';
+                while(idx % TAB_STOP != 0) render[idx++] = ' ';
+            }
+            else{
+                render[idx++] = c;
+            }
+        }
+        row -> rSize = idx;
     }
-    row -> render[idx] = '\0';
-    row -> rSize = idx;
+    row -> staleFrom = -1;
+    TRACE_END(editorUpdateRow);
+}
+
+/* Render columns [col, col + width) of a row editorUpdateRow() has
+   brought up to date; sets *len to their length in bytes. Indexed rows
+   are rendered into buf, which holds SCREEN_LINE_BYTES(width) bytes;
+   other rows return their render buffer or text. */
+char *editorRowRender(erow *row, int col, int width, char *buf, int *len){
+    if(row -> viewFlags & ROW_INDEXED) return editorRowIndexRender(row, col, width, buf, len);
+    *len = row -> rSize - col;
+    if(*len > width) *len = width;
+    if(*len <= 0){
+        *len = 0;
+        return "";
+    }
+    if(row -> flags & ROW_INLINE) return row -> text.inl + col;
+    if(row -> text.ext.view.render) return row -> text.ext.view.render + col;
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    return (aLen ? a : b) + col;
 }
 
 
+static void editorRowInit(erow *row, size_t len){
+    row -> size = len;
+    row -> flags = 0;
+    row -> viewFlags = 0;
+    row -> hlState = 0;
+    /* Rendered on first use, see editorUpdateRow(). */
+    row -> rSize = 0;
+    row -> staleFrom = 0;
+}
+
+/* Gives a new row its own copy of s: inline if it fits, otherwise a gap
+   buffer. */
+static void editorRowCopyIn(erow *row, const char *s, size_t len){
+    if(fitsInline(s, len)){
+        memcpy(row -> text.inl, s, len);
+        row -> flags = ROW_INLINE;
+        return;
+    }
+    int cap;
+    char *chars = editorRowMemAlloc(len, &cap);
+    memcpy(chars, s, len);
+    editorRowSetExt(row, chars, cap);
+}
+
+static erow *editorNewRow(int at, size_t len){
+    erow *row = editorRowStoreInsert(at);
+    editorRowInit(row, len);
+    E.numRows++;
+    editorSyntaxRowInserted(at);
+    return row;
+}
+
+void editorRowInitMapped(erow *row, char *s, size_t len){
+    editorRowInit(row, len);
+    editorRowSetExt(row, s, len);
+    row -> flags = ROW_MAPPED;
+}
+
+/* Initializes a row loaded from a file: inline if it fits, otherwise
+   packed into the loaded text arenas and treated like a mapped row. */
+void editorRowInitCopy(erow *row, const char *s, size_t len){
+    editorRowInit(row, len);
+    if(fitsInline(s, len)){
+        memcpy(row -> text.inl, s, len);
+        row -> flags = ROW_INLINE;
+        return;
+    }
+    editorRowSetExt(row, editorRowMemText(s, len), len);
+    row -> flags = ROW_MAPPED;
+}
+
 void editorInsertRow(int at, char *s, size_t len){
     if(at < 0 || at > E.numRows) return;
 
+    /* s may be the tail of an inline row, which opening the slot for the
+       new row can move. */
+    char copy[ROW_INLINE_BYTES];
+    if(len <= ROW_INLINE_BYTES){
+        memcpy(copy, s, len);
+        s = copy;
+    }
+    erow *row = editorNewRow(at, len);
+    editorRowCopyIn(row, s, len);
+    E.dirty++;
+}
 
-    E.row = realloc(E.row, sizeof(erow) * (E.numRows + 1));
-    memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numRows - at));
-    E.row[at].size = len;
-    E.row[at].chars = malloc(len + 1);
-    memcpy(E.row[at].chars, s, len);
-    E.row[at].chars[len] = '\0';
+void editorInsertMappedRow(int at, char *s, size_t len){
+    if(at < 0 || at > E.numRows) return;
 
-    E.row[at].rSize = 0;
-    E.row[at].render = NULL;
-    editorUpdateRow(&E.row[at]);
-    E.numRows++;
+    erow *row = editorNewRow(at, len);
+    editorRowSetExt(row, s, len);
+    row -> flags = ROW_MAPPED;
     E.dirty++;
 }
 
 void editorRowInsertChar(erow *row, int at, int c){
-    if(at < 0 || at > row -> size) at = row -> size;
-    row -> chars = realloc(row -> chars, row -> size + 2);
-    memmove(&row -> chars[at + 1], &row -> chars[at], row -> size - at + 1);
-    row -> size++;
-    row -> chars[at] = c;
-    editorUpdateRow(row);
-    E.dirty++;
+    char ch = c;
+    editorRowInsertString(row, at, &ch, 1);
 }
 
 
 void editorRowDelChar(erow *row, int at){
-    if(at < 0 || at >= row -> size) return;
-    memmove(&row -> chars[at], &row -> chars[at + 1], row -> size - at);
-    row -> size--;
-    editorUpdateRow(row);
-    E.dirty++;
+    editorRowDelRange(row, at, 1);
 }
 void editorFreeRow(erow *row){
-    free(row -> render);
-    free(row -> chars);
+    if(row -> flags & ROW_INLINE) return;
+    if(row -> viewFlags & ROW_INDEXED) editorRowIndexFree(row);
+    else editorRowMemFree(row -> text.ext.view.render, row -> text.ext.rCap);
+    if(!(row -> flags & ROW_MAPPED)) editorRowMemFree(row -> text.ext.chars, row -> text.ext.cap);
+}
+
+/* Replaces all of a row's text with the 'len' bytes of s in one step: the
+   row is copied in fresh and rendered once, on first use. */
+void editorRowSetText(erow *row, const char *s, size_t len){
+    int hlState = row -> hlState;
+    editorFreeRow(row);
+    editorRowInit(row, len);
+    editorRowCopyIn(row, s, len);
+    row -> hlState = hlState;
+    E.dirty++;
 }
 
 void editorDelRow(int at){
     if(at < 0 || at >= E.numRows) return;
-    editorFreeRow(&E.row[at]);
-    memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.numRows - at - 1));
+    editorFreeRow(editorRowAt(at));
+    editorRowStoreDelete(at);
     E.numRows--;
+    editorSyntaxRowDeleted(at);
     E.dirty++;
 }
 
-void editorRowAppendString(erow *row, char *s, size_t len){
-    row -> chars = realloc(row -> chars, row -> size + len + 1);
-    memcpy(&row -> chars[row -> size], s, len);
+void editorRowInsertString(erow *row, int at, const char *s, size_t len){
+    if(at < 0 || at > row -> size) at = row -> size;
+    if(editorRowPrepare(row, s, len)){
+        memmove(&row -> text.inl[at + len], &row -> text.inl[at], row -> size - at);
+        memcpy(&row -> text.inl[at], s, len);
+    }
+    else{
+        editorRowMoveGap(row, at);
+        memcpy(&row -> text.ext.chars[row -> text.ext.gap], s, len);
+        editorRowIndexTouch(row, at, at + len);
+        row -> text.ext.gap += len;
+    }
     row -> size += len;
-    row -> chars[row -> size] = '\0';
-    editorUpdateRow(row);
+    editorRowInvalidate(row, at);
     E.dirty++;
 }
 
+void editorRowDelRange(erow *row, int at, int len){
+    if(at < 0 || len <= 0 || at + len > row -> size) return;
+    editorRowOwn(row);
+    if(row -> flags & ROW_INLINE){
+        memmove(&row -> text.inl[at], &row -> text.inl[at + len], row -> size - at - len);
+    }
+    else{
+        editorRowMoveGap(row, at + len);
+        row -> text.ext.gap -= len;
+        editorRowIndexTouch(row, at, at + len);
+    }
+    row -> size -= len;
+    editorRowInvalidate(row, at);
+    E.dirty++;
+}
+
+void editorRowAppendString(erow *row, char *s, size_t len){
+    editorRowInsertString(row, row -> size, s, len);
+}
+
 int editorRowRxToCx(erow *row, int rx){
+    editorUpdateRow(row);
+    if(row -> viewFlags & ROW_INDEXED) return editorRowIndexRxToCx(row, rx);
+    if(row -> rSize == row -> size) return rx < row -> size ? rx : row -> size;
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
     int curRx = 0;
     int cx;
     for(cx = 0; cx < row -> size; cx++){
-        if(row -> chars[cx] == '\t'){
-            curRx += (TAB_STOP - 1) + (curRx % TAB_STOP);
+        if((cx < aLen ? a[cx] : b[cx - aLen]) == '\t'){
+            curRx += (TAB_STOP - 1) - (curRx % TAB_STOP);
         }
         curRx++;
         if(curRx > rx){
@@ -0,0 +1,336 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** row column index ***/
+
+/* Rows whose columns are not simply their bytes (ROW_INDEXED) keep no
+   render buffer. These are rows of ROW_LONG_BYTES or more, and rows with
+   non-ASCII text. Instead the row's gap buffer is cut into chunks, and a
+   segment tree over them caches how wide the text of each chunk, and of
+   each run of chunks, renders. Chunks cover the allocation rather than the
+   text, so an edit at the gap only changes the chunks around it; they are
+   recounted on next use and the tree is updated above them. Mapping a
+   column is then a walk down the tree plus decoding one chunk, and drawing
+   decodes only the columns on screen. Chunks are ROW_INDEX_CHUNK_MIN
+   bytes or more, as many as make about 64 per row, up to
+   ROW_INDEX_CHUNK_MAX: short rows decode a few bytes per lookup and long
+   ones keep the tree small.
+
+   Rendered width depends on where a span starts, because of tabs, but
+   only up to its first tab: that tab ends on a tab stop and everything
+   after it renders the same wherever the span starts. So a span is
+   summed up as the columns before its first tab (pre) and the columns
+   after it, counted from a tab stop (post).
+
+   A code point belongs to the chunk holding its first byte. Its other
+   bytes may lie in the next chunk, or across the gap. */
+
+struct colSum {
+    int tab;
+    int pre;
+    int post;
+};
+
+struct rowIndex {
+    /* The buffer the tree was built for; a row that moves to another
+       buffer, or resizes it, is indexed again from scratch. */
+    char *chars;
+    int cap;
+    int shift;
+    int leaves;
+    /* Chunks [dirtyLo, dirtyHi) changed since the tree was updated. */
+    int dirtyLo, dirtyHi;
+    int memCap;
+    struct colSum sum[];
+};
+
+/* The column a span ends on when rendered from column 'col'. */
+static int sumEnd(const struct colSum *s, int col){
+    if(!s -> tab) return col + s -> pre;
+    return ((col + s -> pre) / TAB_STOP + 1) * TAB_STOP + s -> post;
+}
+
+static struct colSum sumJoin(struct colSum l, struct colSum r){
+    struct colSum s;
+    if(!l.tab){
+        s.tab = r.tab;
+        s.pre = l.pre + r.pre;
+        s.post = r.post;
+    }
+    else{
+        s.tab = 1;
+        s.pre = l.pre;
+        s.post = sumEnd(&r, l.post);
+    }
+    return s;
+}
+
+static void sumCols(struct colSum *s, int cols){
+    if(s -> tab) s -> post += cols;
+    else s -> pre += cols;
+}
+
+static void sumTab(struct colSum *s){
+    if(s -> tab) s -> post = (s -> post / TAB_STOP + 1) * TAB_STOP;
+    s -> tab = 1;
+}
+
+/* Adds n bytes of ASCII text to the end of a span. */
+static void sumAscii(struct colSum *s, const char *p, int n){
+    while(n > 0){
+        const char *t = memchr(p, '\t', n);
+        int run = t ? t - p : n;
+        sumCols(s, run);
+        if(t == NULL) return;
+        sumTab(s);
+        p = t + 1;
+        n -= run + 1;
+    }
+}
+
+/* Adds the code points that start in text bytes [from, to) of a row. */
+static void sumRange(erow *row, struct colSum *s, int from, int to){
+    if(from >= to) return;
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    int aTo = to < aLen ? to : aLen;
+    int bFrom = from > aLen ? from : aLen;
+    if((from >= aTo || editorUtf8Ascii(a + from, aTo - from)) &&
+       (bFrom >= to || editorUtf8Ascii(b + bFrom - aLen, to - bFrom))){
+        if(from < aTo) sumAscii(s, a + from, aTo - from);
+        if(bFrom < to) sumAscii(s, b + bFrom - aLen, to - bFrom);
+        return;
+    }
+    int at = from;
+    int cp;
+    /* Skip the tail of a code point that starts before 'from'. */
+    if(at > 0){
+        int j = editorRowCharStart(row, at);
+        if(j < at) at = j + editorRowDecode(row, j, &cp);
+    }
+    while(at < to){
+        int n = editorRowDecode(row, at, &cp);
+        if(cp == '\t') sumTab(s);
+        else sumCols(s, editorUtf8Width(cp));
+        at += n;
+    }
+}
+
+/* Text byte of a row that buffer byte p holds, or that follows it. */
+static int textAt(erow *row, int p){
+    int gap = row -> text.ext.gap;
+    int gapLen = row -> text.ext.cap - row -> size;
+    if(p < gap) return p;
+    return p < gap + gapLen ? gap : p - gapLen;
+}
+
+static void indexLeaf(erow *row, struct rowIndex *idx, int k){
+    struct colSum *s = &idx -> sum[idx -> leaves + k];
+    memset(s, 0, sizeof(*s));
+    int from = k << idx -> shift;
+    if(from >= idx -> cap) return;
+    int to = from + (1 << idx -> shift);
+    if(to > idx -> cap) to = idx -> cap;
+    sumRange(row, s, textAt(row, from), textAt(row, to));
+}
+
+/* Recounts leaf k and the nodes above it. */
+static void indexLeafUp(erow *row, struct rowIndex *idx, int k){
+    indexLeaf(row, idx, k);
+    int node;
+    for(node = (idx -> leaves + k) / 2; node >= 1; node /= 2)
+        idx -> sum[node] = sumJoin(idx -> sum[2 * node], idx -> sum[2 * node + 1]);
+}
+
+static void indexBuild(erow *row){
+    struct rowIndex *idx = row -> text.ext.view.index;
+    int cap = row -> text.ext.cap;
+    int shift = 0;
+    while((1 << shift) < ROW_INDEX_CHUNK_MIN) shift++;
+    while((1 << shift) < ROW_INDEX_CHUNK_MAX && (cap >> shift) > 64) shift++;
+    int chunks = (cap + (1 << shift) - 1) >> shift;
+    int leaves = 1;
+    while(leaves < chunks) leaves <<= 1;
+    if(idx == NULL || idx -> leaves != leaves){
+        int memCap;
+        struct rowIndex *fresh = (struct rowIndex *)editorRowMemAlloc(sizeof(*fresh) + 2 * leaves * sizeof(struct colSum), &memCap);
+        if(idx) editorRowMemFree((char *)idx, idx -> memCap);
+        idx = fresh;
+        idx -> leaves = leaves;
+        idx -> memCap = memCap;
+        row -> text.ext.view.index = idx;
+    }
+    idx -> chars = row -> text.ext.chars;
+    idx -> cap = cap;
+    idx -> shift = shift;
+    idx -> dirtyLo = idx -> dirtyHi = 0;
+    int k;
+    for(k = 0; k < leaves; ++k) indexLeaf(row, idx, k);
+    for(k = leaves - 1; k >= 1; --k) idx -> sum[k] = sumJoin(idx -> sum[2 * k], idx -> sum[2 * k + 1]);
+}
+
+/* Brings the tree up to date with the row's text and returns it. */
+static struct rowIndex *indexSync(erow *row){
+    struct rowIndex *idx = row -> text.ext.view.index;
+    if(idx == NULL || idx -> chars != row -> text.ext.chars || idx -> cap != row -> text.ext.cap){
+        indexBuild(row);
+        return row -> text.ext.view.index;
+    }
+    if(idx -> dirtyLo >= idx -> dirtyHi) return idx;
+    int k;
+    for(k = idx -> dirtyLo; k < idx -> dirtyHi; ++k) indexLeaf(row, idx, k);
+    int lo = (idx -> leaves + idx -> dirtyLo) / 2;
+    int hi = (idx -> leaves + idx -> dirtyHi - 1) / 2;
+    while(lo >= 1){
+        for(k = lo; k <= hi; ++k) idx -> sum[k] = sumJoin(idx -> sum[2 * k], idx -> sum[2 * k + 1]);
+        lo /= 2;
+        hi /= 2;
+    }
+    /* The chunks on either side of the gap are neighbours in the text, so
+       a code point may run from one into the other. */
+    int gap = row -> text.ext.gap;
+    int tail = row -> text.ext.cap - (row -> size - gap);
+    if(gap > 0) indexLeafUp(row, idx, (gap - 1) >> idx -> shift);
+    if(tail < idx -> cap) indexLeafUp(row, idx, tail >> idx -> shift);
+    idx -> dirtyLo = idx -> dirtyHi = 0;
+    return idx;
+}
+
+/* Notes that bytes [from, to) of an indexed row's buffer changed. */
+void editorRowIndexTouch(erow *row, int from, int to){
+    if(!(row -> viewFlags & ROW_INDEXED) || from >= to) return;
+    struct rowIndex *idx = row -> text.ext.view.index;
+    if(idx == NULL) return;
+    /* A code point next to the change may have gained or lost bytes. */
+    from = from > 3 ? from - 3 : 0;
+    to += 3;
+    int lo = from >> idx -> shift;
+    int hi = ((to - 1) >> idx -> shift) + 1;
+    if(hi > idx -> leaves) hi = idx -> leaves;
+    if(idx -> dirtyLo >= idx -> dirtyHi){
+        idx -> dirtyLo = lo;
+        idx -> dirtyHi = hi;
+        return;
+    }
+    if(lo < idx -> dirtyLo) idx -> dirtyLo = lo;
+    if(hi > idx -> dirtyHi) idx -> dirtyHi = hi;
+}
+
+void editorRowIndexFree(erow *row){
+    struct rowIndex *idx = row -> text.ext.view.index;
+    if(idx) editorRowMemFree((char *)idx, idx -> memCap);
+    row -> text.ext.view.index = NULL;
+}
+
+int editorRowIndexWidth(erow *row){
+    return sumEnd(&indexSync(row) -> sum[1], 0);
+}
+
+int editorRowIndexCxToRx(erow *row, int cx){
+    struct rowIndex *idx = indexSync(row);
+    if(cx >= row -> size) return sumEnd(&idx -> sum[1], 0);
+    int p = cx < row -> text.ext.gap ? cx : cx + (row -> text.ext.cap - row -> size);
+    int k = p >> idx -> shift;
+    /* Sum up every chunk before k on the way down, then the start of k. */
+    struct colSum acc = {0, 0, 0};
+    int node = 1, lo = 0, span = idx -> leaves;
+    while(node < idx -> leaves){
+        span /= 2;
+        if(k < lo + span){
+            node = 2 * node;
+        }
+        else{
+            acc = sumJoin(acc, idx -> sum[2 * node]);
+            node = 2 * node + 1;
+            lo += span;
+        }
+    }
+    sumRange(row, &acc, textAt(row, k << idx -> shift), cx);
+    return sumEnd(&acc, 0);
+}
+
+/* Finds the code point covering render column rx; *start is the column it
+   starts on. Returns the row's size if rx is past the end. */
+static int indexFind(erow *row, int rx, int *start){
+    struct rowIndex *idx = indexSync(row);
+    int width = sumEnd(&idx -> sum[1], 0);
+    if(rx >= width){
+        *start = width;
+        return row -> size;
+    }
+    /* Descend to the first chunk that ends past rx. */
+    struct colSum acc = {0, 0, 0};
+    int node = 1;
+    while(node < idx -> leaves){
+        struct colSum left = sumJoin(acc, idx -> sum[2 * node]);
+        if(sumEnd(&left, 0) > rx){
+            node = 2 * node;
+        }
+        else{
+            acc = left;
+            node = 2 * node + 1;
+        }
+    }
+    int at = textAt(row, (node - idx -> leaves) << idx -> shift);
+    int col = sumEnd(&acc, 0);
+    /* Skip the tail of a code point that starts in the chunk before. */
+    if(at > 0){
+        int j = editorRowCharStart(row, at);
+        int cp;
+        if(j < at) at = j + editorRowDecode(row, j, &cp);
+    }
+    while(at < row -> size){
+        int cp;
+        int n = editorRowDecode(row, at, &cp);
+        int next = cp == '\t' ? (col / TAB_STOP + 1) * TAB_STOP : col + editorUtf8Width(cp);
+        if(next > rx) break;
+        col = next;
+        at += n;
+    }
+    *start = col;
+    return at;
+}
+
+int editorRowIndexRxToCx(erow *row, int rx){
+    int start;
+    return indexFind(row, rx, &start);
+}
+
+/* Renders columns [col, col + width) of an indexed row into buf, which
+   holds SCREEN_LINE_BYTES(width) bytes; sets *len to the bytes used. A
+   tab or wide character cut by either edge shows as spaces. */
+char *editorRowIndexRender(erow *row, int col, int width, char *buf, int *len){
+    int c = 0;
+    /* From the very start, so marks with nothing before them show. */
+    int at = col > 0 ? indexFind(row, col, &c) : 0;
+    int end = col + width;
+    int room = SCREEN_LINE_BYTES(width);
+    int n = 0;
+    /* Marks at the left edge belong to a character scrolled off it. */
+    int padded = col > 0;
+    while(at < row -> size){
+        int cp;
+        int cpLen = editorRowDecode(row, at, &cp);
+        int w = cp == '\t' ? (c / TAB_STOP + 1) * TAB_STOP - c : editorUtf8Width(cp);
+        if(w > 0 && c >= end) break;
+        if(n + (cpLen > w ? cpLen : w) > room) break;
+        if(cp == '\t' || c < col || c + w > end){
+            int k;
+            for(k = c < col ? col : c; k < c + w && k < end; ++k) buf[n++] = ' ';
+            padded = 1;
+        }
+        else if(w > 0 || !padded){
+            /* Zero-width marks go with the character before them, so
+               they are dropped after one that was padded out. */
+            int i;
+            for(i = 0; i < cpLen; ++i) buf[n++] = editorRowCharAt(row, at + i);
+            if(w > 0) padded = 0;
+        }
+        c += w;
+        at += cpLen;
+    }
+    *len = n;
+    return buf;
+}
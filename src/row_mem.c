@@ -0,0 +1,142 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** row memory ***/
+
+/* Row gap buffers and render buffers come from here instead of malloc.
+   They are carved out of ROW_ARENA_BYTES arenas in power-of-two size
+   classes from ROW_SLAB_MIN to ROW_SLAB_MAX bytes, and a freed buffer goes
+   on its class's free list for the next request of that class. Callers
+   are given the whole class, so a row uses up that slack before it has to
+   move. Bigger buffers fall back to malloc.
+
+   Text loaded from a file is packed back to back, each line followed by
+   '\n' like in a mapped file, into arenas of its own. Rows point into it
+   as they would into a mapping and copy their text out when first
+   modified, so it is never freed one row at a time.
+
+   Everything is released at once when the buffer is closed. Only the
+   input thread allocates row memory, so nothing here is locked. */
+
+struct rowArena {
+    struct rowArena *next;
+    size_t used, cap;
+    char data[];
+};
+
+/* Header in front of a buffer bigger than ROW_SLAB_MAX. */
+struct rowBig {
+    struct rowBig *prev, *next;
+};
+
+static struct {
+    struct rowArena *slabs;
+    struct rowArena *text;
+    /* One list per size class; more than ROW_SLAB_MAX will ever need. */
+    void *freeList[32];
+    struct rowBig *big;
+} mem;
+
+/* Rounds size up to its class; returns the class index. */
+static int rowClass(int size, int *cap){
+    int k = 0;
+    int c = ROW_SLAB_MIN;
+    while(c < size){
+        c <<= 1;
+        k++;
+    }
+    *cap = c;
+    return k;
+}
+
+/* Takes n bytes from the newest arena in list. A request too big for an
+   arena gets one of its own, linked in behind the newest so the space
+   left in that one is not abandoned. */
+static char *arenaTake(struct rowArena **list, size_t n){
+    struct rowArena *a = *list;
+    if(a == NULL || a -> cap - a -> used < n){
+        size_t cap = n > ROW_ARENA_BYTES ? n : ROW_ARENA_BYTES;
+        struct rowArena *fresh = malloc(sizeof(*fresh) + cap);
+        if(fresh == NULL) die("malloc");
+        fresh -> used = 0;
+        fresh -> cap = cap;
+        if(a && n > ROW_ARENA_BYTES){
+            fresh -> next = a -> next;
+            a -> next = fresh;
+        }
+        else{
+            fresh -> next = a;
+            *list = fresh;
+        }
+        a = fresh;
+    }
+    char *p = a -> data + a -> used;
+    a -> used += n;
+    return p;
+}
+
+/* Returns a buffer of at least size bytes and sets *cap to its full size. */
+char *editorRowMemAlloc(int size, int *cap){
+    if(size > ROW_SLAB_MAX){
+        struct rowBig *b = malloc(sizeof(*b) + size);
+        if(b == NULL) die("malloc");
+        b -> prev = NULL;
+        b -> next = mem.big;
+        if(mem.big) mem.big -> prev = b;
+        mem.big = b;
+        *cap = size;
+        return (char *)(b + 1);
+    }
+    int k = rowClass(size, cap);
+    void **p = mem.freeList[k];
+    if(p){
+        mem.freeList[k] = *p;
+        return (char *)p;
+    }
+    return arenaTake(&mem.slabs, *cap);
+}
+
+/* Gives back a buffer from editorRowMemAlloc(); cap is the size it set. */
+void editorRowMemFree(char *p, int cap){
+    if(p == NULL) return;
+    if(cap > ROW_SLAB_MAX){
+        struct rowBig *b = (struct rowBig *)p - 1;
+        if(b -> prev) b -> prev -> next = b -> next;
+        else mem.big = b -> next;
+        if(b -> next) b -> next -> prev = b -> prev;
+        free(b);
+        return;
+    }
+    int k = rowClass(cap, &cap);
+    *(void **)p = mem.freeList[k];
+    mem.freeList[k] = p;
+}
+
+/* Copies a loaded line into the text arenas, followed by '\n'. */
+char *editorRowMemText(const char *s, size_t len){
+    char *p = arenaTake(&mem.text, len + 1);
+    memcpy(p, s, len);
+    p[len] = '\n';
+    return p;
+}
+
+static void arenaFreeAll(struct rowArena **list){
+    while(*list){
+        struct rowArena *next = (*list) -> next;
+        free(*list);
+        *list = next;
+    }
+}
+
+/* Releases all row memory at once; every row must be gone already. */
+void editorRowMemRelease(){
+    arenaFreeAll(&mem.slabs);
+    arenaFreeAll(&mem.text);
+    while(mem.big){
+        struct rowBig *next = mem.big -> next;
+        free(mem.big);
+        mem.big = next;
+    }
+    memset(mem.freeList, 0, sizeof(mem.freeList));
+}
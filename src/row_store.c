@@ -0,0 +1,312 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** line store ***/
+
+/* Rows are kept in rowBlocks hanging off a counted B-tree. Interior nodes
+   record how many rows sit below each child, so finding line N, opening a
+   slot before it or closing it again only touches one root-to-leaf path. */
+
+#define ROW_BLOCK_MIN (ROW_BLOCK_ROWS / 2)
+#define ROW_NODE_MIN (ROW_NODE_FANOUT / 2)
+
+static int nodeCount(void *node, int height){
+    if(height == 0) return ((rowBlock *)node) -> n;
+    rowNode *in = node;
+    int total = 0;
+    int i;
+    for(i = 0; i < in -> n; ++i) total += in -> counts[i];
+    return total;
+}
+
+static rowBlock *newBlock(){
+    rowBlock *b = malloc(sizeof(rowBlock));
+    if(b == NULL) die("malloc");
+    b -> n = 0;
+    return b;
+}
+
+static rowNode *newNode(){
+    rowNode *in = malloc(sizeof(rowNode));
+    if(in == NULL) die("malloc");
+    in -> n = 0;
+    return in;
+}
+
+/* Opens a slot at row 'at' below 'node'. If the node had to split, the new
+   right sibling is returned through 'split'. */
+static erow *storeInsert(void *node, int height, int at, void **split){
+    *split = NULL;
+    if(height == 0){
+        rowBlock *b = node;
+        if(b -> n == ROW_BLOCK_ROWS){
+            rowBlock *right = newBlock();
+            right -> n = ROW_BLOCK_ROWS - ROW_BLOCK_MIN;
+            memcpy(right -> rows, &b -> rows[ROW_BLOCK_MIN], sizeof(erow) * right -> n);
+            b -> n = ROW_BLOCK_MIN;
+            *split = right;
+            if(at > b -> n){
+                at -= b -> n;
+                b = right;
+            }
+        }
+        memmove(&b -> rows[at + 1], &b -> rows[at], sizeof(erow) * (b -> n - at));
+        b -> n++;
+        return &b -> rows[at];
+    }
+
+    rowNode *in = node;
+    int i = 0;
+    while(i < in -> n - 1 && at > in -> counts[i]){
+        at -= in -> counts[i];
+        i++;
+    }
+    void *kidSplit;
+    erow *slot = storeInsert(in -> kids[i], height - 1, at, &kidSplit);
+    in -> counts[i]++;
+    if(kidSplit == NULL) return slot;
+
+    if(in -> n == ROW_NODE_FANOUT){
+        rowNode *right = newNode();
+        right -> n = ROW_NODE_FANOUT - ROW_NODE_MIN;
+        memcpy(right -> kids, &in -> kids[ROW_NODE_MIN], sizeof(void *) * right -> n);
+        memcpy(right -> counts, &in -> counts[ROW_NODE_MIN], sizeof(int) * right -> n);
+        in -> n = ROW_NODE_MIN;
+        *split = right;
+        if(i >= in -> n){
+            i -= in -> n;
+            in = right;
+        }
+    }
+    memmove(&in -> kids[i + 2], &in -> kids[i + 1], sizeof(void *) * (in -> n - i - 1));
+    memmove(&in -> counts[i + 2], &in -> counts[i + 1], sizeof(int) * (in -> n - i - 1));
+    in -> kids[i + 1] = kidSplit;
+    in -> counts[i] = nodeCount(in -> kids[i], height - 1);
+    in -> counts[i + 1] = nodeCount(kidSplit, height - 1);
+    in -> n++;
+    return slot;
+}
+
+/* Merges or rebalances kids[i] with a neighbour after it dropped below
+   half full. */
+static void storeFixUnderflow(rowNode *in, int height, int i){
+    int l = (i + 1 < in -> n) ? i : i - 1;
+    if(l < 0) return;
+    int r = l + 1;
+
+    if(height == 1){
+        rowBlock *a = in -> kids[l];
+        rowBlock *b = in -> kids[r];
+        if(a -> n + b -> n <= ROW_BLOCK_ROWS){
+            memcpy(&a -> rows[a -> n], b -> rows, sizeof(erow) * b -> n);
+            a -> n += b -> n;
+            free(b);
+        } else {
+            int total = a -> n + b -> n;
+            int want = total / 2;
+            if(a -> n < want){
+                int move = want - a -> n;
+                memcpy(&a -> rows[a -> n], b -> rows, sizeof(erow) * move);
+                memmove(b -> rows, &b -> rows[move], sizeof(erow) * (b -> n - move));
+                a -> n += move;
+                b -> n -= move;
+            } else {
+                int move = a -> n - want;
+                memmove(&b -> rows[move], b -> rows, sizeof(erow) * b -> n);
+                memcpy(b -> rows, &a -> rows[want], sizeof(erow) * move);
+                a -> n -= move;
+                b -> n += move;
+            }
+            in -> counts[l] = a -> n;
+            in -> counts[r] = b -> n;
+            return;
+        }
+    } else {
+        rowNode *a = in -> kids[l];
+        rowNode *b = in -> kids[r];
+        if(a -> n + b -> n <= ROW_NODE_FANOUT){
+            memcpy(&a -> kids[a -> n], b -> kids, sizeof(void *) * b -> n);
+            memcpy(&a -> counts[a -> n], b -> counts, sizeof(int) * b -> n);
+            a -> n += b -> n;
+            free(b);
+        } else {
+            int want = (a -> n + b -> n) / 2;
+            if(a -> n < want){
+                int move = want - a -> n;
+                memcpy(&a -> kids[a -> n], b -> kids, sizeof(void *) * move);
+                memcpy(&a -> counts[a -> n], b -> counts, sizeof(int) * move);
+                memmove(b -> kids, &b -> kids[move], sizeof(void *) * (b -> n - move));
+                memmove(b -> counts, &b -> counts[move], sizeof(int) * (b -> n - move));
+                a -> n += move;
+                b -> n -= move;
+            } else {
+                int move = a -> n - want;
+                memmove(&b -> kids[move], b -> kids, sizeof(void *) * b -> n);
+                memmove(&b -> counts[move], b -> counts, sizeof(int) * b -> n);
+                memcpy(b -> kids, &a -> kids[want], sizeof(void *) * move);
+                memcpy(b -> counts, &a -> counts[want], sizeof(int) * move);
+                a -> n -= move;
+                b -> n += move;
+            }
+            in -> counts[l] = nodeCount(a, height - 1);
+            in -> counts[r] = nodeCount(b, height - 1);
+            return;
+        }
+    }
+
+    /* b was merged into a: drop it from this node. */
+    in -> counts[l] += in -> counts[r];
+    memmove(&in -> kids[r], &in -> kids[r + 1], sizeof(void *) * (in -> n - r - 1));
+    memmove(&in -> counts[r], &in -> counts[r + 1], sizeof(int) * (in -> n - r - 1));
+    in -> n--;
+}
+
+static void storeDelete(void *node, int height, int at){
+    if(height == 0){
+        rowBlock *b = node;
+        memmove(&b -> rows[at], &b -> rows[at + 1], sizeof(erow) * (b -> n - at - 1));
+        b -> n--;
+        return;
+    }
+
+    rowNode *in = node;
+    int i = 0;
+    while(at >= in -> counts[i]){
+        at -= in -> counts[i];
+        i++;
+    }
+    storeDelete(in -> kids[i], height - 1, at);
+    in -> counts[i]--;
+
+    int kidN = (height == 1) ? ((rowBlock *)in -> kids[i]) -> n
+                             : ((rowNode *)in -> kids[i]) -> n;
+    int kidMin = (height == 1) ? ROW_BLOCK_MIN : ROW_NODE_MIN;
+    if(kidN < kidMin) storeFixUnderflow(in, height, i);
+}
+
+static void storeFree(void *node, int height){
+    if(height > 0){
+        rowNode *in = node;
+        int i;
+        for(i = 0; i < in -> n; ++i) storeFree(in -> kids[i], height - 1);
+    }
+    free(node);
+}
+
+erow *editorRowAt(int at){
+    int len;
+    return editorRowRun(at, &len);
+}
+
+erow *editorRowRun(int at, int *len){
+    void *node = E.rows.root;
+    int height = E.rows.height;
+    if(node == NULL || at < 0){
+        *len = 0;
+        return NULL;
+    }
+    while(height > 0){
+        rowNode *in = node;
+        int i = 0;
+        while(i < in -> n - 1 && at >= in -> counts[i]){
+            at -= in -> counts[i];
+            i++;
+        }
+        node = in -> kids[i];
+        height--;
+    }
+    rowBlock *b = node;
+    if(at >= b -> n){
+        *len = 0;
+        return NULL;
+    }
+    *len = b -> n - at;
+    return &b -> rows[at];
+}
+
+erow *editorRowStoreInsert(int at){
+    if(E.rows.root == NULL){
+        E.rows.root = newBlock();
+        E.rows.height = 0;
+    }
+    void *split;
+    erow *slot = storeInsert(E.rows.root, E.rows.height, at, &split);
+    if(split){
+        rowNode *root = newNode();
+        root -> n = 2;
+        root -> kids[0] = E.rows.root;
+        root -> kids[1] = split;
+        root -> counts[0] = nodeCount(E.rows.root, E.rows.height);
+        root -> counts[1] = nodeCount(split, E.rows.height);
+        E.rows.root = root;
+        E.rows.height++;
+    }
+    return slot;
+}
+
+void editorRowStoreDelete(int at){
+    if(E.rows.root == NULL) return;
+    storeDelete(E.rows.root, E.rows.height, at);
+    while(E.rows.height > 0 && ((rowNode *)E.rows.root) -> n == 1){
+        rowNode *root = E.rows.root;
+        E.rows.root = root -> kids[0];
+        free(root);
+        E.rows.height--;
+    }
+}
+
+/* Replaces the store with n rows built bottom-up: fill() is called once
+   per leaf, in order, to initialize its rows. Levels are packed evenly so
+   every node starts at least half full. */
+void editorRowStoreLoad(int n, void (*fill)(erow *rows, int count, void *arg), void *arg){
+    editorRowStoreClear();
+    if(n <= 0) return;
+
+    int nLeaves = (n + ROW_BLOCK_ROWS - 1) / ROW_BLOCK_ROWS;
+    void **level = malloc(sizeof(void *) * nLeaves);
+    int *counts = malloc(sizeof(int) * nLeaves);
+    if(level == NULL || counts == NULL) die("malloc");
+    int i;
+    for(i = 0; i < nLeaves; ++i){
+        rowBlock *b = newBlock();
+        b -> n = n / nLeaves + (i < n % nLeaves);
+        fill(b -> rows, b -> n, arg);
+        level[i] = b;
+        counts[i] = b -> n;
+    }
+
+    int width = nLeaves;
+    int height = 0;
+    while(width > 1){
+        int nNodes = (width + ROW_NODE_FANOUT - 1) / ROW_NODE_FANOUT;
+        int k = 0;
+        for(i = 0; i < nNodes; ++i){
+            rowNode *in = newNode();
+            in -> n = width / nNodes + (i < width % nNodes);
+            int total = 0;
+            int j;
+            for(j = 0; j < in -> n; ++j, ++k){
+                in -> kids[j] = level[k];
+                in -> counts[j] = counts[k];
+                total += counts[k];
+            }
+            level[i] = in;
+            counts[i] = total;
+        }
+        width = nNodes;
+        height++;
+    }
+    E.rows.root = level[0];
+    E.rows.height = height;
+    free(level);
+    free(counts);
+}
+
+/* Drops every row; their text goes back to the row allocator in bulk. */
+void editorRowStoreClear(){
+    if(E.rows.root) storeFree(E.rows.root, E.rows.height);
+    editorRowMemRelease();
+    E.rows.root = NULL;
+    E.rows.height = 0;
+}
@@ -0,0 +1,221 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+/*** substring search ***/
+
+/* Literal search over row text. A query is compiled once into a
+   searchPattern; the scan kernels compare the pattern's first and last
+   bytes against 16 or 32 haystack positions at a time and only verify the
+   few candidates where both line up. In case-insensitive mode letters are
+   folded by OR-ing 0x20 into the haystack bytes, so rows are never
+   copied. */
+
+static int patternVerify(const searchPattern *p, const char *s){
+    if(!p -> icase) return memcmp(s, p -> needle, p -> len) == 0;
+    int i;
+    for(i = 0; i < p -> len; ++i){
+        if(tolower((unsigned char)s[i]) != (unsigned char)p -> needle[i]) return 0;
+    }
+    return 1;
+}
+
+static int findScalar(const searchPattern *p, const char *s, int from, int len){
+    int last = len - p -> len;
+    int i;
+    for(i = from; i <= last; ++i){
+        if(((unsigned char)s[i] | p -> firstFold) != p -> first) continue;
+        if(((unsigned char)s[i + p -> len - 1] | p -> lastFold) != p -> last) continue;
+        if(patternVerify(p, s + i)) return i;
+    }
+    return -1;
+}
+
+#ifdef SEARCH_X86
+static int findSse2(const searchPattern *p, const char *s, int len){
+    const __m128i first = _mm_set1_epi8(p -> first);
+    const __m128i last = _mm_set1_epi8(p -> last);
+    const __m128i firstFold = _mm_set1_epi8(p -> firstFold);
+    const __m128i lastFold = _mm_set1_epi8(p -> lastFold);
+    int end = len - p -> len + 1;
+    int i = 0;
+    for(; i + 16 <= end; i += 16){
+        __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *)(s + i)), firstFold);
+        __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i *)(s + i + p -> len - 1)), lastFold);
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                        _mm_cmpeq_epi8(b, last)));
+        while(mask){
+            int at = i + __builtin_ctz(mask);
+            if(patternVerify(p, s + at)) return at;
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(p, s, i, len);
+}
+
+__attribute__((target("avx2")))
+static int findAvx2(const searchPattern *p, const char *s, int len){
+    const __m256i first = _mm256_set1_epi8(p -> first);
+    const __m256i last = _mm256_set1_epi8(p -> last);
+    const __m256i firstFold = _mm256_set1_epi8(p -> firstFold);
+    const __m256i lastFold = _mm256_set1_epi8(p -> lastFold);
+    int end = len - p -> len + 1;
+    int i = 0;
+    for(; i + 32 <= end; i += 32){
+        __m256i a = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(s + i)), firstFold);
+        __m256i b = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(s + i + p -> len - 1)), lastFold);
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+                                                              _mm256_cmpeq_epi8(b, last)));
+        while(mask){
+            int at = i + __builtin_ctz(mask);
+            if(patternVerify(p, s + at)) return at;
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(p, s, i, len);
+}
+#endif
+
+void editorPatternInit(searchPattern *p, const char *query, int icase){
+    p -> len = strlen(query);
+    p -> needle = malloc(p -> len + 1);
+    p -> window = malloc(2 * p -> len + 1);
+    if(p -> needle == NULL || p -> window == NULL) die("malloc");
+    p -> icase = icase;
+    int i;
+    for(i = 0; i <= p -> len; ++i){
+        p -> needle[i] = icase ? tolower((unsigned char)query[i]) : query[i];
+    }
+    if(p -> len > 0){
+        unsigned char f = p -> needle[0];
+        unsigned char l = p -> needle[p -> len - 1];
+        /* Only letters are folded; 'x' | 0x20 == 'x' matches just 'x'/'X'. */
+        p -> firstFold = (icase && isalpha(f)) ? 0x20 : 0;
+        p -> lastFold = (icase && isalpha(l)) ? 0x20 : 0;
+        p -> first = f;
+        p -> last = l;
+    }
+#ifdef SEARCH_X86
+    p -> kernel = __builtin_cpu_supports("avx2") ? 2 : 1;
+#else
+    p -> kernel = 0;
+#endif
+}
+
+void editorPatternFree(searchPattern *p){
+    free(p -> needle);
+    free(p -> window);
+    p -> needle = NULL;
+    p -> window = NULL;
+}
+
+int editorPatternFind(const searchPattern *p, const char *s, int from, int len){
+    if(p -> len == 0 || len - from < p -> len) return -1;
+    int at;
+#ifdef SEARCH_X86
+    if(p -> kernel == 2) at = findAvx2(p, s + from, len - from);
+    else at = findSse2(p, s + from, len - from);
+#else
+    at = findScalar(p, s + from, 0, len - from);
+#endif
+    return at < 0 ? -1 : at + from;
+}
+
+/* First match at or after column 'from' of a row, read across the gap. */
+int editorSearchRow(searchPattern *p, erow *row, int from){
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+
+    int at;
+    if(from < aLen){
+        at = editorPatternFind(p, a, from, aLen);
+        if(at >= 0) return at;
+
+        /* Matches that straddle the gap: search the bytes around it. */
+        int left = aLen - from < p -> len - 1 ? aLen - from : p -> len - 1;
+        int right = bLen < p -> len - 1 ? bLen : p -> len - 1;
+        if(left > 0 && right > 0){
+            memcpy(p -> window, a + aLen - left, left);
+            memcpy(p -> window + left, b, right);
+            at = editorPatternFind(p, p -> window, 0, left + right);
+            if(at >= 0) return aLen - left + at;
+        }
+        from = aLen;
+    }
+    at = editorPatternFind(p, b, from - aLen, bLen);
+    return at < 0 ? -1 : aLen + at;
+}
+
+/* Whether the pattern occurs at exactly column 'at' of a row. */
+int editorPatternMatchAt(searchPattern *p, erow *row, int at){
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    if(p -> len == 0 || at < 0 || at + p -> len > aLen + bLen) return 0;
+    if(at + p -> len <= aLen) return patternVerify(p, a + at);
+    if(at >= aLen) return patternVerify(p, b + at - aLen);
+    int left = aLen - at;
+    memcpy(p -> window, a + at, left);
+    memcpy(p -> window + left, b, p -> len - left);
+    return patternVerify(p, p -> window);
+}
+
+/* Rows loaded from a mapping sit back to back in it, separated by "\n" or
+   "\r\n". Such runs are scanned as one buffer: queries never contain
+   control characters, so a hit can never span a separator. */
+static int mappedNext(erow *row, erow *next){
+    if(!(row -> flags & ROW_MAPPED) || !(next -> flags & ROW_MAPPED)) return 0;
+    char *end = row -> text.ext.chars + row -> size;
+    ptrdiff_t sep = next -> text.ext.chars - end;
+    if(sep == 1) return end[0] == '\n';
+    if(sep == 2) return end[0] == '\r' && end[1] == '\n';
+    return 0;
+}
+
+/* Finds the first match in rows [at, end), starting at column 'from' of
+   row 'at'. Returns the row index and sets *col, or returns -1. */
+int editorSearchForward(searchPattern *p, int at, int from, int end, int *col){
+    if(at < end && from > 0){
+        int c = editorSearchRow(p, editorRowAt(at), from);
+        if(c >= 0){
+            *col = c;
+            return at;
+        }
+        at++;
+    }
+    while(at < end){
+        int runLen;
+        erow *run = editorRowRun(at, &runLen);
+        if(runLen > end - at) runLen = end - at;
+        int k = 0;
+        while(k < runLen){
+            int g = k;
+            while(g + 1 < runLen && mappedNext(&run[g], &run[g + 1])) g++;
+            if(g == k){
+                int c = editorSearchRow(p, &run[k], 0);
+                if(c >= 0){
+                    *col = c;
+                    return at + k;
+                }
+            } else {
+                char *base = run[k].text.ext.chars;
+                int len = run[g].text.ext.chars + run[g].size - base;
+                int hit = editorPatternFind(p, base, 0, len);
+                if(hit >= 0){
+                    while(run[k].text.ext.chars + run[k].size <= base + hit) k++;
+                    *col = base + hit - run[k].text.ext.chars;
+                    return at + k;
+                }
+            }
+            k = g + 1;
+        }
+        at += runLen;
+    }
+    return -1;
+}
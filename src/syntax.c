@@ -0,0 +1,402 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** syntax highlighting ***/
+
+/* Rows are highlighted by a small lexer picked by file name. The only
+   thing one row passes on to the next is the lexer state at its end
+   (inside a block comment or a continued string), and every row keeps
+   that in hlState. A row can then be highlighted from its predecessor's
+   hlState alone, and only the states of rows above the screen ever need
+   to be up to date.
+
+   States are valid for rows below validTo, and rows below lexedTo have
+   been lexed at some point. Edits lower validTo to the row they touch and
+   raise dirtyTo past it: rows from dirtyTo on still have the text their
+   state was computed from; dirtyTo drops back to validTo once relexing
+   has passed it. Bringing states up to date relexes forward
+   from validTo and stops at the last row about to be drawn. When a row
+   at or past dirtyTo ends in the state it had before, every row after it
+   up to lexedTo would end the same way again, so lexing skips to there.
+   Typing relexes one row per key, and opening a comment at the top of a
+   big file relexes one screen per key, not the file.
+
+   Rows of ROW_LONG_BYTES or more are not lexed, so drawing a huge line
+   does not scan it from the start; the state passes through them. */
+
+#define HL_NUMBERS (1 << 0)
+#define HL_STRINGS (1 << 1)
+
+enum { HLS_NORMAL = 0, HLS_COMMENT, HLS_STRING, HLS_CHAR };
+
+struct editorSyntax {
+    const char *fileType;
+    const char **fileMatch;
+    /* Keywords ending in '|' are types (HL_KEYWORD2). */
+    const char **keywords;
+    const char *lineComment;
+    const char *blockStart;
+    const char *blockEnd;
+    int flags;
+};
+
+static const char *cExtensions[] = {".c", ".h", ".cc", ".cpp", ".cxx", ".hh", ".hpp", NULL};
+static const char *cKeywords[] = {
+    "switch", "if", "while", "for", "break", "continue", "return", "else",
+    "struct", "union", "typedef", "static", "enum", "class", "case", "goto",
+    "default", "do", "sizeof", "const", "volatile", "extern", "inline",
+    "register", "restrict", "namespace", "template", "typename", "public",
+    "private", "protected", "virtual", "new", "delete", "using", "#include",
+    "#define", "#if", "#ifdef", "#ifndef", "#else", "#elif", "#endif",
+    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
+    "void|", "short|", "size_t|", "ssize_t|", "bool|", "auto|", NULL
+};
+
+static const struct editorSyntax HLDB[] = {
+    {"c", cExtensions, cKeywords, "//", "/*", "*/", HL_NUMBERS | HL_STRINGS},
+};
+
+/* What the lexer needs to know about a byte, looked up in byteKind. */
+#define BK_SEPARATOR (1 << 0)
+#define BK_WORD (1 << 1)
+#define BK_DIGIT (1 << 2)
+#define BK_WORD_START (1 << 3)
+
+static unsigned char byteKind[256];
+
+static void byteKindInit(){
+    int c;
+    for(c = 0; c < 256; ++c){
+        int k = 0;
+        if(isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];{}&|!^?:", c) != NULL) k |= BK_SEPARATOR;
+        if(isalnum(c) || c == '_') k |= BK_WORD;
+        if(isdigit(c)) k |= BK_DIGIT;
+        if(isalpha(c) || c == '_' || c == '#') k |= BK_WORD_START;
+        byteKind[c] = k;
+    }
+}
+
+static struct {
+    const struct editorSyntax *syntax;
+    int validTo;
+    int dirtyTo;
+    int lexedTo;
+    /* Classes of the bytes of the row being drawn. */
+    unsigned char *hl;
+    int hlCap;
+    /* Classes of the columns of recently drawn rows, so that a frame
+       only lexes the rows that scrolled in or changed. A row is kept in
+       slot fileRow % nLines along with what its classes depend on. */
+    struct synLine {
+        int fileRow, col, width;
+        int state;
+    } *lines;
+    unsigned char *linesHl;
+    int nLines, lineCap;
+} syn;
+
+/* Drops the cached columns of rows from 'from' on. */
+static void syntaxForget(int from){
+    int k;
+    for(k = 0; k < syn.nLines; ++k){
+        if(syn.lines[k].fileRow >= from) syn.lines[k].fileRow = -1;
+    }
+}
+
+/* Picks the syntax for fileName by its extension and forgets all row
+   states; call once the rows are loaded. */
+void editorSyntaxSelect(const char *fileName){
+    syn.syntax = NULL;
+    syn.validTo = 0;
+    syn.dirtyTo = 0;
+    syn.lexedTo = 0;
+    syntaxForget(0);
+    if(byteKind[' '] == 0) byteKindInit();
+    const char *ext = fileName ? strrchr(fileName, '.') : NULL;
+    if(ext == NULL) return;
+    size_t i;
+    for(i = 0; i < sizeof(HLDB) / sizeof(HLDB[0]); ++i){
+        const char **m;
+        for(m = HLDB[i].fileMatch; *m; ++m){
+            if(strcmp(ext, *m) == 0){
+                syn.syntax = &HLDB[i];
+                return;
+            }
+        }
+    }
+}
+
+/* Name of the current syntax, or NULL when there is none. */
+const char *editorSyntaxName(){
+    return syn.syntax ? syn.syntax -> fileType : NULL;
+}
+
+/* The text of a row changed. */
+void editorSyntaxTouch(int row){
+    if(row < syn.validTo) syn.validTo = row;
+    if(row + 1 > syn.dirtyTo) syn.dirtyTo = row + 1;
+    if(syn.nLines && syn.lines[row % syn.nLines].fileRow == row) syn.lines[row % syn.nLines].fileRow = -1;
+}
+
+/* A row was inserted at 'at'. The state of the row after it was computed
+   for a different predecessor, so that one must be relexed too. */
+void editorSyntaxRowInserted(int at){
+    if(syn.dirtyTo > at) syn.dirtyTo++;
+    if(syn.lexedTo > at) syn.lexedTo++;
+    syntaxForget(at);
+    editorSyntaxTouch(at);
+    if(syn.dirtyTo < at + 2) syn.dirtyTo = at + 2;
+}
+
+/* The row at 'at' was deleted; the one now there follows a new row. */
+void editorSyntaxRowDeleted(int at){
+    if(syn.dirtyTo > at) syn.dirtyTo--;
+    if(syn.lexedTo > at) syn.lexedTo--;
+    syntaxForget(at);
+    editorSyntaxTouch(at);
+}
+
+#define ROW_BYTE(at) ((unsigned char)((at) < aLen ? a[at] : b[(at) - aLen]))
+
+/* Whether the len bytes of a row from 'at' on are s. */
+static int rowMatch(const char *a, int aLen, const char *b, int size, int at, const char *s, int len){
+    if(at + len > size) return 0;
+    int i;
+    for(i = 0; i < len; ++i){
+        if(ROW_BYTE(at + i) != (unsigned char)s[i]) return 0;
+    }
+    return 1;
+}
+
+/* Where the first of the bytes in 'stops' is from 'at' on in a row, or
+   'end' if none is before it. next[] remembers where each was found, so
+   a lexer moving forward searches each part of the row once per byte. */
+static int rowFindAny(const char *a, int aLen, const char *b, int at, int end, const char *stops, int *next){
+    int best = end;
+    int k;
+    for(k = 0; stops[k]; ++k){
+        if(next[k] < at){
+            const char *p = NULL;
+            if(at < aLen) p = memchr(a + at, stops[k], (end < aLen ? end : aLen) - at);
+            if(p) next[k] = p - a;
+            else if(end > aLen){
+                int from = at > aLen ? at : aLen;
+                p = memchr(b + from - aLen, stops[k], end - from);
+                next[k] = p ? aLen + (p - b) : end;
+            }
+            else next[k] = end;
+        }
+        if(next[k] < best) best = next[k];
+    }
+    return best;
+}
+
+/* Lexes a row that starts in 'state' and returns its end state. With hl,
+   also stores the classes of bytes [from, to) there, and stops after
+   them; without, and before 'from', only what changes the state is
+   looked at. */
+static int syntaxLex(erow *row, int state, unsigned char *hl, int from, int to){
+    const struct editorSyntax *s = syn.syntax;
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    int size = hl && to < row -> size ? to : row -> size;
+    /* Keywords and numbers only depend on the bytes just before them:
+       classify from the start of the word 'from' is in. */
+    if(hl == NULL) from = size;
+    else while(from > 0 && (byteKind[ROW_BYTE(from - 1)] & BK_WORD)) from--;
+    const char *lc = s -> lineComment;
+    const char *bs = s -> blockStart;
+    const char *be = s -> blockEnd;
+    int lcLen = lc ? strlen(lc) : 0;
+    int bsLen = bs ? strlen(bs) : 0;
+    int beLen = be ? strlen(be) : 0;
+    /* Before 'from', runs of bytes that cannot change the state are
+       skipped over with memchr(). */
+    char stops[4][5] = {"\"'", "", "\\\"", "\\'"};
+    if(lcLen) strncat(stops[HLS_NORMAL], lc, 1);
+    if(bsLen) strncat(stops[HLS_NORMAL], bs, 1);
+    if(beLen) strncat(stops[HLS_COMMENT], be, 1);
+    int next[4][4];
+    memset(next, -1, sizeof(next));
+    int prevSep = 1;
+    int prevHl = HL_NORMAL;
+    int escaped = 0;
+    int i = 0;
+    while(i < size){
+        if(i < from - 1 && !escaped){
+            int j = rowFindAny(a, aLen, b, i, from - 1, stops[state], next[state]);
+            if(j > i){
+                i = j;
+                continue;
+            }
+        }
+        unsigned char c = ROW_BYTE(i);
+        int cls = HL_NORMAL;
+        int n = 1;
+        if(state == HLS_COMMENT){
+            cls = HL_COMMENT;
+            if(c == (unsigned char)be[0] && rowMatch(a, aLen, b, size, i, be, beLen)){
+                n = beLen;
+                state = HLS_NORMAL;
+            }
+        }
+        else if(state == HLS_STRING || state == HLS_CHAR){
+            cls = HL_STRING;
+            if(escaped) escaped = 0;
+            else if(c == '\\') escaped = 1;
+            else if(c == (state == HLS_STRING ? '"' : '\'')) state = HLS_NORMAL;
+        }
+        else if(lcLen && c == (unsigned char)lc[0] && rowMatch(a, aLen, b, size, i, lc, lcLen)){
+            if(hl) memset(hl + i, HL_COMMENT, size - i);
+            return HLS_NORMAL;
+        }
+        else if(bsLen && c == (unsigned char)bs[0] && rowMatch(a, aLen, b, size, i, bs, bsLen)){
+            cls = HL_COMMENT;
+            n = bsLen;
+            state = HLS_COMMENT;
+        }
+        else if((s -> flags & HL_STRINGS) && (c == '"' || c == '\'')){
+            cls = HL_STRING;
+            state = c == '"' ? HLS_STRING : HLS_CHAR;
+        }
+        else if(i < from){
+            /* Keywords and numbers do not change the state. */
+        }
+        else if((s -> flags & HL_NUMBERS) &&
+                (((byteKind[c] & BK_DIGIT) && (prevSep || prevHl == HL_NUMBER)) ||
+                 ((c == '.' || (byteKind[c] & BK_WORD)) && prevHl == HL_NUMBER))){
+            cls = HL_NUMBER;
+        }
+        else if(prevSep && (byteKind[c] & BK_WORD_START)){
+            /* A word: a keyword if it is one and ends at a separator. */
+            int end = row -> size;
+            while(i + n < end && (byteKind[ROW_BYTE(i + n)] & BK_WORD)) n++;
+            const char **k = s -> keywords;
+            if(i + n < end && !(byteKind[ROW_BYTE(i + n)] & BK_SEPARATOR)) k = NULL;
+            for(; k && *k; ++k){
+                if((unsigned char)(*k)[0] != c) continue;
+                int len = strlen(*k);
+                int type = (*k)[len - 1] == '|';
+                if(len - type != n || !rowMatch(a, aLen, b, end, i, *k, n)) continue;
+                cls = type ? HL_KEYWORD2 : HL_KEYWORD1;
+                break;
+            }
+            if(n > size - i) n = size - i;
+        }
+        if(hl && i + n >= from){
+            memset(hl + i, cls, n);
+            prevSep = cls == HL_NORMAL && (byteKind[c] & BK_SEPARATOR);
+            prevHl = cls;
+        }
+        i += n;
+    }
+    /* A string goes on to the next row only after a backslash. */
+    if((state == HLS_STRING || state == HLS_CHAR) && !escaped) state = HLS_NORMAL;
+    return state;
+}
+
+static int syntaxStart(int fileRow){
+    return fileRow > 0 ? editorRowAt(fileRow - 1) -> hlState : HLS_NORMAL;
+}
+
+/* Brings the end states of the rows above 'upTo' up to date. */
+void editorSyntaxUpdate(int upTo){
+    if(syn.syntax == NULL) return;
+    if(upTo > E.numRows) upTo = E.numRows;
+    if(syn.validTo >= upTo) return;
+    TRACE_BEGIN(editorSyntaxUpdate);
+    int k = syn.validTo;
+    while(k < upTo){
+        int len;
+        erow *run = editorRowRun(k, &len);
+        int state = syntaxStart(k);
+        int i;
+        for(i = 0; i < len && k < upTo; ++i){
+            erow *row = &run[i];
+            if(row -> size < ROW_LONG_BYTES) state = syntaxLex(row, state, NULL, 0, row -> size);
+            int same = row -> hlState == state;
+            row -> hlState = state;
+            k++;
+            if(same && k >= syn.dirtyTo && k < syn.lexedTo){
+                /* Converged: the rows after it end as they did. */
+                k = syn.lexedTo;
+                break;
+            }
+        }
+    }
+    syn.validTo = k;
+    if(syn.lexedTo < k) syn.lexedTo = k;
+    /* Every edited row has been relexed: the rows from here on are as
+       they were lexed, so the skip applies to them again. */
+    if(syn.validTo >= syn.dirtyTo) syn.dirtyTo = syn.validTo;
+    TRACE_END(editorSyntaxUpdate);
+}
+
+/* Lexes a row that starts in 'state' into the classes of its render
+   columns [col, col + width). */
+static void syntaxColumns(erow *row, int state, int col, int width, unsigned char *hl){
+    if(row -> size > syn.hlCap){
+        syn.hlCap = row -> size * 2;
+        syn.hl = realloc(syn.hl, syn.hlCap);
+        if(syn.hl == NULL) die("realloc");
+    }
+    /* Only the bytes up to the right edge are needed. */
+    int at = editorRowRxToCx(row, col);
+    int last = editorRowRxToCx(row, col + width);
+    if(last < row -> size) last = editorRowNextCx(row, last);
+    syntaxLex(row, state, syn.hl, at, last);
+    int indexed = row -> viewFlags & ROW_INDEXED;
+    if(!indexed && row -> rSize == row -> size){
+        /* A byte is a column. */
+        int n = row -> size - col < width ? row -> size - col : width;
+        if(n < 0) n = 0;
+        memcpy(hl, syn.hl + col, n);
+        memset(hl + n, HL_NORMAL, width - n);
+        return;
+    }
+    memset(hl, HL_NORMAL, width);
+    /* Spread the byte classes over the columns they render to. Rows that
+       are not indexed are ASCII, so only their tabs take more than one. */
+    char *a, *b;
+    int aLen, bLen;
+    editorRowSpans(row, &a, &aLen, &b, &bLen);
+    int rx = editorRowCxToRx(row, at);
+    while(at < last && rx < col + width){
+        int cp;
+        int n = indexed ? editorRowDecode(row, at, &cp) : (cp = ROW_BYTE(at), 1);
+        int w = cp == '\t' ? TAB_STOP - rx % TAB_STOP : indexed ? editorUtf8Width(cp) : 1;
+        int k;
+        for(k = rx < col ? col : rx; k < rx + w && k < col + width; ++k) hl[k - col] = syn.hl[at];
+        rx += w;
+        at += n;
+    }
+}
+
+/* Fills hl with the classes of render columns [col, col + width) of a file
+   row whose predecessor's state is up to date, from the cache if they are
+   there. Returns 0, leaving hl alone, when the row is not highlighted. */
+int editorSyntaxRow(erow *row, int fileRow, int col, int width, unsigned char *hl){
+    if(syn.syntax == NULL || row -> size >= ROW_LONG_BYTES || width <= 0) return 0;
+    int state = syntaxStart(fileRow);
+    if(syn.nLines != E.screenRows + 1 || syn.lineCap < width){
+        syn.nLines = E.screenRows + 1;
+        syn.lineCap = width > E.screenCols ? width : E.screenCols;
+        syn.lines = realloc(syn.lines, syn.nLines * sizeof(*syn.lines));
+        syn.linesHl = realloc(syn.linesHl, syn.nLines * syn.lineCap);
+        if(syn.lines == NULL || syn.linesHl == NULL) die("realloc");
+        syntaxForget(0);
+    }
+    struct synLine *l = &syn.lines[fileRow % syn.nLines];
+    unsigned char *cached = syn.linesHl + fileRow % syn.nLines * syn.lineCap;
+    if(l -> fileRow != fileRow || l -> col != col || l -> width != width || l -> state != state){
+        syntaxColumns(row, state, col, width, cached);
+        l -> fileRow = fileRow;
+        l -> col = col;
+        l -> width = width;
+        l -> state = state;
+    }
+    memcpy(hl, cached, width);
+    return 1;
+}
@@ -2,14 +2,47 @@
 #include "../include/data.h"
 #include "../include/prototypes.h"
 
+/* Self-pipe that lets worker threads and the SIGWINCH handler interrupt
+   a blocking editorReadKey(). */
+static int wakePipe[2] = {-1, -1};
+static volatile sig_atomic_t resized;
+
+/* Bytes read from the terminal but not decoded yet. Each read() takes
+   everything available, so a burst of keys or a whole escape sequence
+   costs one system call and is decoded from memory. */
+static struct {
+    char *buf;
+    size_t off, len, cap;
+} input;
+
+/* Text of the last bracketed paste. */
+static struct {
+    char *buf;
+    size_t len, cap;
+} paste;
+
+#define PASTE_START "\x1b[200~"
+#define PASTE_END "\x1b[201~"
+#define PASTE_MARK_LEN 6
+
 void die(const char *s){
+    editorJournalFlush();
     write(STDOUT_FILENO, "\x1b[2J", 4);
     write(STDOUT_FILENO, "\x1b[H", 3);
     perror(s);
     exit(1);
 }
 
+static void handleWinch(int sig){
+    (void)sig;
+    int saved = errno;
+    resized = 1;
+    editorWake();
+    errno = saved;
+}
+
 void disableRawMode(){
+    write(STDOUT_FILENO, "\x1b[?2004l", 8);
     if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1) die("tcsetattr");
 }
 
@@ -23,24 +56,218 @@ void enableRawMode(){
     raw.c_oflag &= ~(OPOST);
     raw.c_cflag |= (CS8);
     raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
-    raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    /* Reads block until a byte arrives; editorReadKey() waits in poll()
+       and times out escape sequences itself. */
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
     if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) die("tcsetattr");
+    /* Bracketed paste: the terminal wraps pasted text in PASTE_START and
+       PASTE_END, so it can be inserted in one operation. */
+    write(STDOUT_FILENO, "\x1b[?2004h", 8);
+
+    if(pipe(wakePipe) == -1) die("pipe");
+    fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handleWinch;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGWINCH, &sa, NULL) == -1) die("sigaction");
+}
+
+/* Makes the next (or a pending) editorReadKey() return WAKE_KEY. Safe to
+   call from any thread. */
+void editorWake(){
+    char c = 'w';
+    if(wakePipe[1] != -1) write(wakePipe[1], &c, 1);
+}
+
+/* Refills the empty input buffer with one read(). End of input means the
+   terminal has gone away and is reported as EIO. */
+static ssize_t inputFill(){
+    if(input.cap == 0){
+        input.cap = INPUT_BUF_BYTES;
+        input.buf = malloc(input.cap);
+        if(input.buf == NULL) die("malloc");
+    }
+    input.off = input.len = 0;
+    ssize_t r = read(STDIN_FILENO, input.buf, input.cap);
+    if(r == 0){
+        errno = EIO;
+        return -1;
+    }
+    if(r > 0) input.len = r;
+    return r;
+}
+
+/* Queues bytes as if the terminal had sent them; used to replay key
+   scripts without a terminal. */
+void editorInputFeed(const char *s, size_t len){
+    if(input.off == input.len) input.off = input.len = 0;
+    if(input.cap - input.len < len){
+        size_t cap = input.cap ? input.cap : INPUT_BUF_BYTES;
+        while(cap - input.len < len) cap *= 2;
+        input.buf = realloc(input.buf, cap);
+        if(input.buf == NULL) die("realloc");
+        input.cap = cap;
+    }
+    memcpy(input.buf + input.len, s, len);
+    input.len += len;
+}
+
+/* Whether keys are already buffered, i.e. editorReadKey() will return
+   without waiting. */
+int editorInputPending(){
+    return input.off < input.len;
+}
+
+/* One more byte of an escape sequence, or 0 if none arrives within
+   ESC_SEQ_TIMEOUT_MS (a lone Escape key press). */
+static int readSeqByte(char *c){
+    if(input.off == input.len){
+        struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+        if(poll(&fd, 1, ESC_SEQ_TIMEOUT_MS) <= 0 || inputFill() <= 0) return 0;
+    }
+    *c = input.buf[input.off++];
+    return 1;
+}
+
+/* Picks up a new terminal size after SIGWINCH. */
+static void editorUpdateWindowSize(){
+    int rows, cols;
+    if(getWindowSize(&rows, &cols) == -1) return;
+    E.screenRows = rows > 2 ? rows - 2 : 1;
+    E.screenCols = cols;
+    editorInvalidateFrame();
+}
+
+/* How long editorReadKey() may block: until the journal is due to be
+   flushed or the status message expires, or forever if neither is
+   pending, so an idle editor is never woken. */
+static int editorPollTimeout(){
+    int timeout = editorJournalDueMs();
+    if(E.statusMsg[0]){
+        time_t left = E.statusMsgTime + STATUS_MSG_SECONDS - time(NULL);
+        if(left > 0 && (timeout == -1 || left * 1000 < timeout)) timeout = left * 1000;
+    }
+    return timeout;
+}
+
+/* Collects a paste after its start marker has been read: the payload is
+   taken from the input buffer and then read in large blocks straight into
+   paste.buf, up to the end marker. */
+static int editorReadPaste(){
+    paste.len = 0;
+    while(1){
+        if(paste.cap - paste.len < 65536){
+            paste.cap = paste.cap ? paste.cap * 2 : 131072;
+            paste.buf = realloc(paste.buf, paste.cap);
+            if(paste.buf == NULL) die("realloc");
+        }
+        size_t scanFrom = paste.len >= PASTE_MARK_LEN - 1 ? paste.len - (PASTE_MARK_LEN - 1) : 0;
+        size_t n;
+        int buffered = input.off < input.len;
+        if(buffered){
+            n = input.len - input.off;
+            if(n > paste.cap - paste.len) n = paste.cap - paste.len;
+            memcpy(paste.buf + paste.len, input.buf + input.off, n);
+            input.off += n;
+        }
+        else{
+            ssize_t r = read(STDIN_FILENO, paste.buf + paste.len, paste.cap - paste.len);
+            if(r == 0){
+                errno = EIO;
+                r = -1;
+            }
+            if(r == -1){
+                if(errno == EAGAIN || errno == EINTR) continue;
+                die("read");
+            }
+            n = r;
+        }
+        paste.len += n;
+
+        char *end = memmem(paste.buf + scanFrom, paste.len - scanFrom, PASTE_END, PASTE_MARK_LEN);
+        if(end == NULL) continue;
+        /* Bytes after the end marker all came in this last chunk; hand
+           them back to the key decoder. */
+        size_t after = paste.buf + paste.len - (end + PASTE_MARK_LEN);
+        if(buffered) input.off -= after;
+        else if(after){
+            if(input.cap < after){
+                input.buf = realloc(input.buf, after);
+                if(input.buf == NULL) die("realloc");
+                input.cap = after;
+            }
+            memcpy(input.buf, end + PASTE_MARK_LEN, after);
+            input.off = 0;
+            input.len = after;
+        }
+
+        /* Terminals send line breaks in a paste as "\r"; store "\n". */
+        size_t i, out = 0;
+        for(i = 0; i < (size_t)(end - paste.buf); ++i){
+            if(paste.buf[i] == '\r'){
+                paste.buf[out++] = '\n';
+                if(i + 1 < (size_t)(end - paste.buf) && paste.buf[i + 1] == '\n') i++;
+            }
+            else paste.buf[out++] = paste.buf[i];
+        }
+        paste.len = out;
+        return PASTE_KEY;
+    }
+}
+
+/* The text of the paste editorReadKey() last returned PASTE_KEY for. */
+char *editorPasteText(size_t *len){
+    *len = paste.len;
+    return paste.buf;
 }
 
 int editorReadKey(){
-    int nread;
-    char c;
-    while((nread = read(STDIN_FILENO, &c, 1)) != 1){
-        if(nread == -1 && errno != EAGAIN) die("read");
+    while(input.off == input.len){
+        struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wakePipe[0], POLLIN, 0}};
+        int ready = poll(fds, wakePipe[0] == -1 ? 1 : 2, editorPollTimeout());
+        if(ready == -1){
+            if(errno == EINTR) continue;
+            die("poll");
+        }
+        if(ready == 0){
+            /* A timer fired: flush the journal if it is due, and redraw so
+               an expired status message disappears. */
+            if(editorJournalDueMs() == 0) editorJournalFlush();
+            return WAKE_KEY;
+        }
+        /* Keys take priority over wakeups. */
+        if(fds[0].revents){
+            if(inputFill() == -1 && errno != EAGAIN && errno != EINTR) die("read");
+        }
+        else if(fds[1].revents){
+            char drain[64];
+            while(read(wakePipe[0], drain, sizeof(drain)) > 0);
+            if(resized){
+                resized = 0;
+                editorUpdateWindowSize();
+            }
+            return WAKE_KEY;
+        }
     }
+    char c = input.buf[input.off++];
     if (c == '\x1b') {
-        char seq[3];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+        char seq[5];
+        if (!readSeqByte(&seq[0])) return '\x1b';
+        if (!readSeqByte(&seq[1])) return '\x1b';
         if (seq[0] == '[') {
             if(seq[1] >= '0' && seq[1] <= '9'){
-                if(read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
+                if(!readSeqByte(&seq[2])) return '\x1b';
+                /* The only longer sequence understood is the paste start. */
+                if(seq[1] == '2' && seq[2] == '0'){
+                    if(readSeqByte(&seq[3]) && readSeqByte(&seq[4]) &&
+                       memcmp(seq, PASTE_START + 1, 5) == 0)
+                        return editorReadPaste();
+                    return '\x1b';
+                }
                 if(seq[2] == '~'){
                     switch(seq[1]){
                         case '1': return HOME_KEY;
@@ -65,7 +292,8 @@ int editorReadKey(){
         }
         return '\x1b';
   } else {
-        return c;
+        /* Bytes of UTF-8 text come through as 128..255. */
+        return (unsigned char)c;
     }
 }
 
@@ -75,7 +303,7 @@ int getCursorPosition(int *rows, int *cols){
     if(write(STDOUT_FILENO, "\x1b[6n", 4) != 4) return -1;
 
     while(i < sizeof(buf) - 1){
-        if(read(STDIN_FILENO, &buf[i], 1) != 1) break;
+        if(!readSeqByte(&buf[i])) break;
         if(buf[i] == 'R') break;
         i++;
     }
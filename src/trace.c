@@ -0,0 +1,154 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** tracing ***/
+
+/* Hot paths are wrapped in TRACE_BEGIN/TRACE_END scopes (see common.h)
+   that append a complete event to a fixed ring buffer. Writers claim a
+   slot with one atomic increment, so worker threads can trace too and no
+   lock is ever taken; the oldest events are overwritten. The ring can be
+   written out as Chrome trace_event JSON (chrome://tracing, Perfetto),
+   and per-frame totals feed the on-screen overlay. Building with
+   TRACE=0 removes all of it. */
+
+#ifndef B_NO_TRACE
+
+struct traceEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t dur;
+    int tid;
+};
+
+static struct {
+    struct traceEvent ev[TRACE_RING_EVENTS];
+    uint64_t head;
+    int nextTid;
+} ring;
+
+static __thread int traceTid;
+
+/* Allocation calls made by editor code. The link wraps malloc, calloc and
+   realloc (see the Makefile) so each one bumps this counter. */
+static uint64_t allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size){
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size){
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size){
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+uint64_t editorTraceNow(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void editorTraceEvent(const char *name, uint64_t start){
+    uint64_t end = editorTraceNow();
+    if(traceTid == 0) traceTid = __atomic_add_fetch(&ring.nextTid, 1, __ATOMIC_RELAXED);
+    uint64_t i = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+    struct traceEvent *e = &ring.ev[i & (TRACE_RING_EVENTS - 1)];
+    e -> name = name;
+    e -> start = start;
+    e -> dur = end - start;
+    e -> tid = traceTid;
+}
+
+/* Writes the events still in the ring as Chrome trace_event JSON. Events
+   being written concurrently may come out torn; this is meant to run once
+   the editor is idle, e.g. at exit. */
+int editorTraceDump(const char *path){
+    FILE *fp = fopen(path, "w");
+    if(fp == NULL) return -1;
+    uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+    uint64_t i = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    fputs("{\"traceEvents\":[\n", fp);
+    int first = 1;
+    for(; i < head; ++i){
+        struct traceEvent *e = &ring.ev[i & (TRACE_RING_EVENTS - 1)];
+        if(e -> name == NULL) continue;
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",\n", e -> name, e -> tid, e -> start / 1e3, e -> dur / 1e3);
+        first = 0;
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", fp);
+    return fclose(fp) == EOF ? -1 : 0;
+}
+
+static const char *dumpPath;
+
+static void traceDumpAtExit(){
+    editorTraceDump(dumpPath);
+}
+
+/* Arranges for the ring to be written to path when the editor exits. */
+void editorTraceDumpAtExit(const char *path){
+    if(dumpPath == NULL) atexit(traceDumpAtExit);
+    dumpPath = path;
+}
+
+/*** perf overlay ***/
+
+static struct {
+    int shown;
+    uint64_t frameNs;
+    int bytes;
+    uint64_t allocs;
+    uint64_t lastAllocs;
+} overlay;
+
+void editorTraceToggleOverlay(){
+    overlay.shown = !overlay.shown;
+    editorSetStatusMessage(overlay.shown ? "Perf overlay on" : "Perf overlay off");
+}
+
+/* Records the totals of a finished frame: its time, its bytes, and the
+   allocations made since the previous frame, i.e. while handling the key
+   that caused it and drawing it. */
+void editorTraceFrame(uint64_t start, int bytes){
+    uint64_t now = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+    overlay.frameNs = editorTraceNow() - start;
+    overlay.bytes = bytes;
+    overlay.allocs = now - overlay.lastAllocs;
+    overlay.lastAllocs = now;
+}
+
+/* Formats the overlay into buf; returns 0 when it is hidden. */
+int editorTraceOverlay(char *buf, int size){
+    if(!overlay.shown) return 0;
+    return snprintf(buf, size, "frame %.3f ms | %d bytes | %llu allocs",
+                    overlay.frameNs / 1e6, overlay.bytes, (unsigned long long)overlay.allocs);
+}
+
+#else
+
+void editorTraceDumpAtExit(const char *path){
+    (void)path;
+}
+
+void editorTraceToggleOverlay(){
+    editorSetStatusMessage("Perf overlay not built in (TRACE=0)");
+}
+
+int editorTraceOverlay(char *buf, int size){
+    (void)buf;
+    (void)size;
+    return 0;
+}
+
+#endif
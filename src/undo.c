@@ -0,0 +1,309 @@
+#include "../include/common.h"
+#include "../include/data.h"
+#include "../include/prototypes.h"
+
+/*** undo ***/
+
+/* Undo history is a log of edit records with a cursor into it: records
+   before 'pos' can be undone, records from 'pos' on can be redone, and a
+   new edit drops the redo side. A run of typing, or of deleting, in one
+   place is merged into a single record whose text grows in place, so the
+   log grows with the amount of text changed rather than with keystrokes.
+   Record text lives in a chunked arena that is only ever appended to at
+   the end and cut back when redo records are dropped. */
+
+enum { UNDO_INSERT = 1, UNDO_DELETE, UNDO_SPLIT, UNDO_JOIN, UNDO_NEWROW, UNDO_TEXT, UNDO_REPLACE };
+
+/* Set on a record that is undone and redone together with the one before
+   it, e.g. the character typed into the row editorInsertChar() appended. */
+#define UNDO_CHAINED 1
+/* Set on a UNDO_DELETE run made with backspace; its text is stored last
+   deleted first, i.e. reversed. */
+#define UNDO_BACKWARD 2
+
+struct undoRecord {
+    int op;
+    int flags;
+    int row, col;
+    int chunk;
+    size_t off, len;
+};
+
+struct undoChunk {
+    size_t cap, used;
+    char data[];
+};
+
+static struct {
+    struct undoRecord *recs;
+    int n, cap, pos;
+    struct undoChunk **chunks;
+    int nChunks, capChunks;
+    int applying;
+    int chainNext;
+} undo;
+
+static char *undoText(struct undoRecord *r){
+    if(r -> len == 0) return NULL;
+    return undo.chunks[r -> chunk] -> data + r -> off;
+}
+
+static void undoNewChunk(size_t min){
+    if(undo.nChunks == undo.capChunks){
+        undo.capChunks = undo.capChunks ? undo.capChunks * 2 : 8;
+        undo.chunks = realloc(undo.chunks, undo.capChunks * sizeof(*undo.chunks));
+        if(undo.chunks == NULL) die("realloc");
+    }
+    size_t cap = min > UNDO_CHUNK_BYTES ? min : UNDO_CHUNK_BYTES;
+    struct undoChunk *c = malloc(sizeof(*c) + cap);
+    if(c == NULL) die("malloc");
+    c -> cap = cap;
+    c -> used = 0;
+    undo.chunks[undo.nChunks++] = c;
+}
+
+/* Appends to the text of the newest record, which always ends at the top
+   of the arena. A record that outgrows its chunk moves to a new one at
+   least twice its size, so growth stays amortized O(1). */
+static void undoAppend(struct undoRecord *r, const char *s, size_t n){
+    struct undoChunk *top = undo.nChunks ? undo.chunks[undo.nChunks - 1] : NULL;
+    if(top == NULL || top -> cap - top -> used < n){
+        undoNewChunk(2 * (r -> len + n));
+        struct undoChunk *fresh = undo.chunks[undo.nChunks - 1];
+        if(r -> len) memcpy(fresh -> data, undoText(r), r -> len);
+        if(top && r -> len && r -> chunk == undo.nChunks - 2) top -> used -= r -> len;
+        fresh -> used = r -> len;
+        r -> chunk = undo.nChunks - 1;
+        r -> off = 0;
+        top = fresh;
+    }
+    memcpy(top -> data + top -> used, s, n);
+    top -> used += n;
+    r -> len += n;
+}
+
+/* Forgets every record from 'pos' on and returns their arena space. */
+static void undoTruncate(){
+    if(undo.pos == undo.n) return;
+    int keepChunk = 0;
+    size_t keepUsed = 0;
+    if(undo.pos > 0){
+        struct undoRecord *last = &undo.recs[undo.pos - 1];
+        keepChunk = last -> chunk;
+        keepUsed = last -> off + last -> len;
+    }
+    while(undo.nChunks > keepChunk + 1) free(undo.chunks[--undo.nChunks]);
+    if(undo.nChunks) undo.chunks[keepChunk] -> used = keepUsed;
+    undo.n = undo.pos;
+}
+
+static struct undoRecord *undoPush(int op, int row, int col){
+    undoTruncate();
+    if(undo.n == undo.cap){
+        undo.cap = undo.cap ? undo.cap * 2 : 64;
+        undo.recs = realloc(undo.recs, undo.cap * sizeof(*undo.recs));
+        if(undo.recs == NULL) die("realloc");
+    }
+    struct undoRecord *r = &undo.recs[undo.n++];
+    r -> op = op;
+    r -> flags = undo.chainNext ? UNDO_CHAINED : 0;
+    r -> row = row;
+    r -> col = col;
+    r -> chunk = undo.nChunks ? undo.nChunks - 1 : 0;
+    r -> off = undo.nChunks ? undo.chunks[undo.nChunks - 1] -> used : 0;
+    r -> len = 0;
+    undo.chainNext = 0;
+    undo.pos = undo.n;
+    return r;
+}
+
+/* The newest record, if new edits may still be merged into it. */
+static struct undoRecord *undoTop(int op){
+    if(undo.pos != undo.n || undo.n == 0 || undo.chainNext) return NULL;
+    struct undoRecord *r = &undo.recs[undo.n - 1];
+    return r -> op == op ? r : NULL;
+}
+
+void editorUndoInsertChar(int row, int col, int c){
+    if(undo.applying) return;
+    struct undoRecord *r = undoTop(UNDO_INSERT);
+    if(r == NULL || r -> row != row || r -> col + (int)r -> len != col)
+        r = undoPush(UNDO_INSERT, row, col);
+    char ch = c;
+    undoAppend(r, &ch, 1);
+}
+
+void editorUndoDelChar(int row, int col, int c){
+    if(undo.applying) return;
+    char ch = c;
+    struct undoRecord *r = undoTop(UNDO_DELETE);
+    if(r && r -> row == row){
+        if(r -> col == col + 1 && (r -> len == 1 || (r -> flags & UNDO_BACKWARD))){
+            r -> flags |= UNDO_BACKWARD;
+            r -> col = col;
+            undoAppend(r, &ch, 1);
+            return;
+        }
+        if(r -> col == col && !(r -> flags & UNDO_BACKWARD)){
+            undoAppend(r, &ch, 1);
+            return;
+        }
+    }
+    r = undoPush(UNDO_DELETE, row, col);
+    undoAppend(r, &ch, 1);
+}
+
+void editorUndoSplit(int row, int col){
+    if(undo.applying) return;
+    undoPush(UNDO_SPLIT, row, col);
+}
+
+void editorUndoJoin(int row, int col){
+    if(undo.applying) return;
+    undoPush(UNDO_JOIN, row, col);
+}
+
+/* A block of text, possibly spanning lines, inserted in one operation. */
+void editorUndoInsertText(int row, int col, const char *s, size_t len){
+    if(undo.applying) return;
+    struct undoRecord *r = undoPush(UNDO_TEXT, row, col);
+    undoAppend(r, s, len);
+}
+
+/* A replace-all of 'query' with 'with' (see replace.c). Its text is the
+   two strings, then the matches added by editorUndoReplaceRow(). */
+void editorUndoReplace(const char *query, const char *with){
+    if(undo.applying) return;
+    struct undoRecord *r = undoPush(UNDO_REPLACE, -1, 0);
+    int len[2] = {strlen(query), strlen(with)};
+    undoAppend(r, (const char *)len, sizeof(len));
+    undoAppend(r, query, len[0]);
+    undoAppend(r, with, len[1]);
+}
+
+/* The columns, before replacing, of the n matches replaced in row 'at'
+   by the replace-all just recorded. */
+void editorUndoReplaceRow(int at, const int *cols, int n){
+    if(undo.applying) return;
+    struct undoRecord *r = &undo.recs[undo.n - 1];
+    if(r -> row == -1){
+        /* The cursor goes to the first match on undo and redo. */
+        r -> row = at;
+        r -> col = cols[0];
+    }
+    int head[2] = {at, n};
+    undoAppend(r, (const char *)head, sizeof(head));
+    undoAppend(r, (const char *)cols, n * sizeof(*cols));
+}
+
+/* An empty row appended past the last one. With chain set, the next
+   record is undone and redone together with it. */
+void editorUndoNewRow(int row, int chain){
+    if(undo.applying) return;
+    undoPush(UNDO_NEWROW, row, 0);
+    undo.chainNext = chain;
+}
+
+/* Replays a record through the normal editing operations (so the edit
+   journal sees undo and redo like any other edit), forwards or in
+   reverse. Either way the work is proportional to the record's text. */
+static void undoApply(struct undoRecord *r, int reverse){
+    char *text = undoText(r);
+    size_t i;
+    int op = r -> op;
+    if(reverse){
+        switch(op){
+            case UNDO_INSERT: op = UNDO_DELETE; break;
+            case UNDO_DELETE: op = UNDO_INSERT; break;
+            case UNDO_SPLIT: op = UNDO_JOIN; break;
+            case UNDO_JOIN: op = UNDO_SPLIT; break;
+        }
+    }
+    E.cy = r -> row;
+    E.cx = r -> col;
+    switch(op){
+        case UNDO_INSERT:
+            for(i = 0; i < r -> len; ++i){
+                size_t k = (r -> flags & UNDO_BACKWARD) ? r -> len - 1 - i : i;
+                editorInsertChar(text[k]);
+            }
+            /* A forward-delete run leaves the cursor where it started. */
+            if(r -> op == UNDO_DELETE && !(r -> flags & UNDO_BACKWARD)) E.cx = r -> col;
+            break;
+        case UNDO_DELETE:
+            E.cx = r -> col + r -> len;
+            for(i = 0; i < r -> len; ++i) editorDelChar();
+            break;
+        case UNDO_SPLIT:
+            if(r -> op == UNDO_JOIN){
+                /* Undoing a join of row 'row' into the one above at 'col'. */
+                E.cy = r -> row - 1;
+            }
+            editorInsertNewline();
+            if(r -> op == UNDO_JOIN){
+                E.cy = r -> row;
+                E.cx = 0;
+            }
+            break;
+        case UNDO_JOIN:
+            if(r -> op == UNDO_SPLIT) E.cy = r -> row + 1;
+            E.cx = 0;
+            editorDelChar();
+            break;
+        case UNDO_TEXT:
+            if(reverse){
+                int endRow = r -> row;
+                int endCol = r -> col;
+                for(i = 0; i < r -> len; ++i){
+                    if(text[i] == '\n'){
+                        endRow++;
+                        endCol = 0;
+                    }
+                    else endCol++;
+                }
+                editorDelRange(r -> row, r -> col, endRow, endCol);
+                E.cy = r -> row;
+                E.cx = r -> col;
+            }
+            else editorInsertText(text, r -> len);
+            break;
+        case UNDO_REPLACE:
+            editorReplaceReplay(text, r -> len, reverse);
+            E.cy = r -> row;
+            E.cx = r -> col;
+            break;
+        case UNDO_NEWROW:
+            if(reverse){
+                editorJournalDelRow(r -> row);
+                editorDelRow(r -> row);
+            }
+            else editorInsertNewline();
+            break;
+    }
+}
+
+void editorUndo(){
+    if(undo.pos == 0){
+        editorSetStatusMessage("Nothing to undo");
+        return;
+    }
+    undo.applying = 1;
+    struct undoRecord *r;
+    do{
+        r = &undo.recs[--undo.pos];
+        undoApply(r, 1);
+    } while((r -> flags & UNDO_CHAINED) && undo.pos > 0);
+    undo.applying = 0;
+}
+
+void editorRedo(){
+    if(undo.pos == undo.n){
+        editorSetStatusMessage("Nothing to redo");
+        return;
+    }
+    undo.applying = 1;
+    do{
+        undoApply(&undo.recs[undo.pos++], 0);
+    } while(undo.pos < undo.n && (undo.recs[undo.pos].flags & UNDO_CHAINED));
+    undo.applying = 0;
+}